@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// A buffered line reader
+//
+// Instead of pulling one byte at a time through fgetc(), this reads a
+// big block of the file with fread() and then uses memchr() to find the
+// newlines in it. Each line comes back as a pointer into the block and
+// a length, so most lines are never copied at all.
+//
+// The only time we copy is when a line straddles the end of the block.
+// Then we slide the partial line down to the front of the block and
+// fread() more data in behind it. If a single line is bigger than the
+// whole block, the block doubles in size.
+
+#define LINEREADER_BLOCK_SIZE (1024 * 1024)
+
+struct linereader {
+    FILE *fp;
+    char *buf;       // The block
+    size_t bufsize;  // Size of the block, not counting the NUL byte
+    size_t start;    // Index of the first unconsumed byte in the block
+    size_t end;      // Index one past the last valid byte in the block
+    int eof;         // True when fread() has nothing more to give
+};
+
+// Set up a line reader on an open file
+//
+// Returns 0 on success, -1 if we couldn't allocate the block.
+
+int linereader_init(struct linereader *lr, FILE *fp, size_t bufsize)
+{
+    lr->fp = fp;
+    lr->bufsize = bufsize;
+    lr->start = lr->end = 0;
+    lr->eof = 0;
+
+    lr->buf = malloc(bufsize + 1);  // +1 for a NUL terminator
+
+    return lr->buf == NULL? -1: 0;
+}
+
+// Free the block
+//
+// Any line pointers returned by linereader_next() are invalid after
+// this.
+
+void linereader_free(struct linereader *lr)
+{
+    free(lr->buf);
+    lr->buf = NULL;
+}
+
+// Refill the block after the unconsumed bytes
+//
+// Returns 0 on success, -1 on allocation failure.
+
+static int linereader_fill(struct linereader *lr)
+{
+    size_t remaining = lr->end - lr->start;
+
+    if (lr->start > 0) {
+        // Slide the partial line to the front of the block
+        memmove(lr->buf, lr->buf + lr->start, remaining);
+        lr->start = 0;
+        lr->end = remaining;
+
+    } else if (remaining == lr->bufsize) {
+        // The block is full of one line, so make room for more
+        size_t new_size = lr->bufsize * 2;
+        char *new_buf = realloc(lr->buf, new_size + 1);
+
+        if (new_buf == NULL)
+            return -1;
+
+        lr->buf = new_buf;
+        lr->bufsize = new_size;
+    }
+
+    size_t n = fread(lr->buf + lr->end, 1, lr->bufsize - lr->end, lr->fp);
+
+    if (n == 0)
+        lr->eof = 1;
+
+    lr->end += n;
+
+    return 0;
+}
+
+// Get the next line
+//
+// Returns a pointer to the line and stores its length in *len. The
+// newline is not included, and the line is NUL-terminated for
+// convenience.
+//
+// Returns NULL on EOF or error. Use ferror() on the file to tell which.
+//
+// The pointer is only good until the next call to linereader_next(),
+// and the caller must not free() it.
+
+char *linereader_next(struct linereader *lr, size_t *len)
+{
+    // Where to pick up the newline search, so we don't rescan bytes
+    // that we already know aren't newlines
+    size_t scanned = 0;
+
+    for (;;) {
+        char *line = lr->buf + lr->start;
+        size_t avail = lr->end - lr->start;
+        char *nl = memchr(line + scanned, '\n', avail - scanned);
+
+        if (nl != NULL) {
+            *len = nl - line;
+            *nl = '\0';
+            lr->start += *len + 1;  // +1 to skip the newline
+
+            return line;
+        }
+
+        if (lr->eof) {
+            // No newline at the end of the file, but there might still
+            // be a last line sitting in the block
+            if (avail == 0)
+                return NULL;
+
+            *len = avail;
+            line[avail] = '\0';
+            lr->start = lr->end;
+
+            return line;
+        }
+
+        scanned = avail;
+
+        if (linereader_fill(lr) == -1)
+            return NULL;
+    }
+}
+
+// ---------------------------------------------------------------------
+// The original byte-at-a-time readline(), for comparison
+
+char *readline(FILE *fp)
+{
+    int offset = 0;   // Index next char goes in the buffer
+    int bufsize = 4;  // Preferably power of 2 initial size
+    char *buf;        // The buffer
+    int c;            // The character we've read in
+
+    buf = malloc(bufsize);  // Allocate initial buffer
+
+    if (buf == NULL)   // Error check
+        return NULL;
+
+    // Main loop--read until newline or EOF
+    while (c = fgetc(fp), c != '\n' && c != EOF) {
+
+        // Check if we're out of room in the buffer accounting
+        // for the extra byte for the NUL terminator
+        if (offset == bufsize - 1) {  // -1 for the NUL terminator
+            bufsize *= 2;  // 2x the space
+
+            char *new_buf = realloc(buf, bufsize);
+
+            if (new_buf == NULL) {
+                free(buf);   // On error, free and bail
+                return NULL;
+            }
+
+            buf = new_buf;  // Successful realloc
+        }
+
+        buf[offset++] = c;  // Add the byte onto the buffer
+    }
+
+    // If at EOF and we read no bytes, free the buffer and
+    // return NULL to indicate we're at EOF:
+    if (c == EOF && offset == 0) {
+        free(buf);
+        return NULL;
+    }
+
+    // Shrink to fit
+    if (offset < bufsize - 1) {  // If we're short of the end
+        char *new_buf = realloc(buf, offset + 1); // +1 for NUL terminator
+
+        if (new_buf != NULL)
+            buf = new_buf;
+    }
+
+    // Add the NUL terminator
+    buf[offset] = '\0';
+
+    return buf;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Write about `size` bytes of lines with random lengths to a temp file
+FILE *make_test_file(size_t size)
+{
+    FILE *fp = tmpfile();
+
+    if (fp == NULL)
+        return NULL;
+
+    char line[256];
+    size_t written = 0;
+
+    srand(1);
+
+    while (written < size) {
+        int len = rand() % 200;
+
+        for (int i = 0; i < len; i++)
+            line[i] = 'a' + rand() % 26;
+
+        line[len] = '\n';
+        fwrite(line, 1, len + 1, fp);
+
+        written += len + 1;
+    }
+
+    rewind(fp);
+
+    return fp;
+}
+
+int main(int argc, char **argv)
+{
+    // Size of the test file in megabytes
+    size_t mb = argc > 1? strtoul(argv[1], NULL, 10): 1024;
+
+    printf("Generating %zu MB test file...\n", mb);
+
+    FILE *fp = make_test_file(mb * 1024 * 1024);
+
+    if (fp == NULL) {
+        perror("tmpfile");
+        return 1;
+    }
+
+    size_t lines = 0, bytes = 0;
+    double t0, t1;
+    char *line;
+
+    // Old way
+    t0 = now();
+
+    while ((line = readline(fp)) != NULL) {
+        lines++;
+        bytes += strlen(line);
+        free(line);
+    }
+
+    t1 = now();
+
+    printf("readline():        %zu lines, %zu bytes, %.2f s, %.1f MB/s\n",
+        lines, bytes, t1 - t0, mb / (t1 - t0));
+
+    // New way
+    rewind(fp);
+    lines = bytes = 0;
+
+    struct linereader lr;
+    size_t len;
+
+    if (linereader_init(&lr, fp, LINEREADER_BLOCK_SIZE) == -1) {
+        fprintf(stderr, "linereader_init: out of memory\n");
+        return 1;
+    }
+
+    t0 = now();
+
+    while ((line = linereader_next(&lr, &len)) != NULL) {
+        lines++;
+        bytes += len;
+    }
+
+    t1 = now();
+
+    printf("linereader_next(): %zu lines, %zu bytes, %.2f s, %.1f MB/s\n",
+        lines, bytes, t1 - t0, mb / (t1 - t0));
+
+    linereader_free(&lr);
+    fclose(fp);
+}
@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdalign.h>
+#include <time.h>
+#include <threads.h>
+#include <stdatomic.h>
+
+// Finding out which compare-and-swap loops are fighting
+//
+// A CAS loop like the one in the atomic_compare_exchange() reference
+// page example goes around again every time another thread changes the
+// value first. Under contention that can be a lot of trips, but there's
+// no way to tell from the outside.
+//
+// CAS_LOOP() wraps up the loop. It backs off a little more after each
+// failure, and it starts backing off sooner at call sites that have
+// been needing retries lately. It also records how many retries each
+// call took in a histogram for that call site. cas_stats_print() dumps
+// them all.
+//
+// The counters are kept in a few stripes, each on its own cache line,
+// and each thread sticks to one stripe. Otherwise every thread would be
+// hammering the same counters right after the CAS they're fighting
+// over, and we'd be measuring our own contention.
+//
+// Build with -DCAS_STATS_OFF and the recording compiles away to
+// nothing, leaving only the loop and the backoff.
+//
+// Of course, the best CAS loop is no CAS loop. If all you're doing is
+// adding, atomic_fetch_add() can't fail and never retries.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_PAUSE() __builtin_ia32_pause()
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define CPU_PAUSE() __asm__ __volatile__("yield")
+#else
+#define CPU_PAUSE() ((void)0)
+#endif
+
+#define CAS_BACKOFF_MAX_SHIFT 10  // At most 1024 pauses in a row
+#define CAS_YIELD_AFTER 16        // Retries before we start yielding
+
+// Wait a bit before the next try. The more times we've failed, the
+// longer we wait.
+void cas_backoff(int retries)
+{
+    if (retries >= CAS_YIELD_AFTER) {
+        thrd_yield();
+        return;
+    }
+
+    int shift = retries < CAS_BACKOFF_MAX_SHIFT? retries: CAS_BACKOFF_MAX_SHIFT;
+
+    for (int i = 0; i < 1 << shift; i++)
+        CPU_PAUSE();
+}
+
+// Each thread keeps a running average of how many retries a call site
+// needed, in eighths of a retry, with the latest call counting for a
+// quarter. CAS_LOOP() starts its backoff that far along.
+int cas_adapt(int avg, int retries)
+{
+    if (retries > CAS_YIELD_AFTER)
+        retries = CAS_YIELD_AFTER;
+
+    return avg + (retries * 8 - avg) / 4;
+}
+
+#ifndef CAS_STATS_OFF
+
+// Bucket 0 is no retries, bucket 1 is 1, bucket 2 is 2-3, bucket 3 is
+// 4-7, and so on. The last bucket gets everything bigger.
+#define CAS_HIST_BUCKETS 10
+
+#define CAS_STRIPES 16   // Threads past this many share stripes
+#define CAS_LINE_SIZE 64
+
+struct cas_counts {
+    alignas(CAS_LINE_SIZE) atomic_long calls;
+    atomic_long retries;
+    atomic_long hist[CAS_HIST_BUCKETS];
+};
+
+struct cas_site {
+    const char *name;
+    const char *file;
+    int line;
+    struct cas_counts stripe[CAS_STRIPES];
+    atomic_bool registered;
+    struct cas_site *next;
+};
+
+// All the sites that have run at least once
+_Atomic(struct cas_site *) cas_sites;
+
+// Which stripe this thread uses, handed out in turn
+atomic_int cas_next_stripe;
+thread_local int cas_stripe = -1;
+
+void cas_record(struct cas_site *site, int retries)
+{
+    // First time through? Add this site to the list.
+    if (!atomic_load_explicit(&site->registered, memory_order_relaxed) &&
+        !atomic_exchange(&site->registered, true)) {
+
+        site->next = atomic_load(&cas_sites);
+
+        while (!atomic_compare_exchange_weak(&cas_sites, &site->next, site));
+    }
+
+    int bucket = 0;
+
+    for (int r = retries; r > 0 && bucket < CAS_HIST_BUCKETS - 1; r >>= 1)
+        bucket++;
+
+    if (cas_stripe == -1)
+        cas_stripe = atomic_fetch_add(&cas_next_stripe, 1) % CAS_STRIPES;
+
+    struct cas_counts *c = &site->stripe[cas_stripe];
+
+    atomic_fetch_add_explicit(&c->calls, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->retries, retries, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->hist[bucket], 1, memory_order_relaxed);
+}
+
+// Add up all the stripes for a site
+static void cas_totals(struct cas_site *s, long *calls, long *retries,
+                       long hist[CAS_HIST_BUCKETS])
+{
+    *calls = *retries = 0;
+
+    for (int b = 0; b < CAS_HIST_BUCKETS; b++)
+        hist[b] = 0;
+
+    for (int i = 0; i < CAS_STRIPES; i++) {
+        struct cas_counts *c = &s->stripe[i];
+
+        *calls += atomic_load(&c->calls);
+        *retries += atomic_load(&c->retries);
+
+        for (int b = 0; b < CAS_HIST_BUCKETS; b++)
+            hist[b] += atomic_load(&c->hist[b]);
+    }
+}
+
+void cas_stats_print(FILE *fp)
+{
+    for (struct cas_site *s = atomic_load(&cas_sites); s != NULL; s = s->next) {
+        long calls, retries, hist[CAS_HIST_BUCKETS];
+
+        cas_totals(s, &calls, &retries, hist);
+
+        fprintf(fp, "%s (%s:%d): %ld calls, %ld retries, "
+            "%.1f%% of CAS attempts failed\n", s->name, s->file, s->line,
+            calls, retries, 100.0 * retries / (calls + retries));
+
+        for (int i = 0; i < CAS_HIST_BUCKETS; i++) {
+            long count = hist[i];
+            int lo = i == 0? 0: 1 << (i - 1);
+
+            if (count == 0)
+                continue;
+
+            if (i == 0)
+                fprintf(fp, "    %9d retries: %ld\n", 0, count);
+            else if (i == CAS_HIST_BUCKETS - 1)
+                fprintf(fp, "    %8d+ retries: %ld\n", lo, count);
+            else
+                fprintf(fp, "    %4d-%4d retries: %ld\n", lo, lo * 2 - 1, count);
+        }
+    }
+}
+
+#define CAS_SITE(site) \
+    static struct cas_site cas_site_ ## site = { \
+        .name=#site, .file=__FILE__, .line=__LINE__ \
+    }
+
+#define CAS_RECORD(site, retries) cas_record(&cas_site_ ## site, (retries))
+
+#else
+
+#define CAS_SITE(site)
+#define CAS_RECORD(site, retries) ((void)(retries))
+#define cas_stats_print(fp) ((void)(fp))
+
+#endif
+
+// Run update, then try to CAS obj from expected to desired, until it
+// works. update should compute desired from expected. On failure,
+// expected is refreshed with the current value.
+//
+// site is a name for this call site in the stats.
+//
+// Example:
+//
+//     int cur = atomic_load(&value), next;
+//     CAS_LOOP(add_two, &value, cur, next, next = cur + 2);
+
+#define CAS_LOOP(site, obj, expected, desired, update) do { \
+    CAS_SITE(site); \
+    static thread_local int cas_avg_; \
+    int cas_retries_ = 0; \
+    for (;;) { \
+        update; \
+        if (atomic_compare_exchange_weak((obj), &(expected), (desired))) \
+            break; \
+        cas_backoff(cas_avg_ / 8 + cas_retries_++); \
+    } \
+    cas_avg_ = cas_adapt(cas_avg_, cas_retries_); \
+    CAS_RECORD(site, cas_retries_); \
+} while (0)
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+#define MAX_THREADS 64
+
+atomic_int value;
+atomic_int max_seen;
+long loop_count;
+int use_fetch_add;
+
+// The run() from atomic_compare_exchange.c, with the loop instrumented
+// or replaced by a fetch-op
+int run(void *arg)
+{
+    int id = *(int*)arg;
+
+    for (long i = 0; i < loop_count; i++) {
+        if (use_fetch_add) {
+            atomic_fetch_add(&value, 2);
+        } else {
+            int cur = atomic_load(&value), next;
+            CAS_LOOP(add_two, &value, cur, next, next = cur + 2);
+        }
+
+        // Something there's no fetch-op for: keep track of the biggest
+        // (made-up) measurement any thread has seen. This one rarely
+        // changes, so it should rarely retry.
+        int m = atomic_load(&max_seen), sample = (i * 7919 + id) % 100000;
+
+        if (sample > m) {
+            int new_max;
+            CAS_LOOP(track_max, &max_seen, m, new_max,
+                new_max = sample > m? sample: m);
+        }
+    }
+
+    return 0;
+}
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double bench(int fetch_add, int nthreads)
+{
+    thrd_t t[MAX_THREADS];
+    int id[MAX_THREADS];
+
+    use_fetch_add = fetch_add;
+    atomic_store(&value, 0);
+
+    double t0 = now();
+
+    for (int i = 0; i < nthreads; i++) {
+        id[i] = i;
+        thrd_create(t + i, run, id + i);
+    }
+
+    for (int i = 0; i < nthreads; i++)
+        thrd_join(t[i], NULL);
+
+    double t1 = now();
+
+    if (atomic_load(&value) != loop_count * nthreads * 2)
+        printf("MISMATCH: %d should equal %ld\n", atomic_load(&value),
+            loop_count * nthreads * 2);
+
+    return t1 - t0;
+}
+
+int main(int argc, char **argv)
+{
+    int nthreads = argc > 1? atoi(argv[1]): 8;
+    loop_count = argc > 2? atol(argv[2]): 1000000;
+
+    if (nthreads > MAX_THREADS)
+        nthreads = MAX_THREADS;
+
+    double cas_time = bench(0, nthreads);
+    double fetch_time = bench(1, nthreads);
+
+    printf("%d threads, %ld increments each\n", nthreads, loop_count);
+    printf("CAS loop:          %.3f s\n", cas_time);
+    printf("atomic_fetch_add:  %.3f s\n\n", fetch_time);
+
+    cas_stats_print(stdout);
+}
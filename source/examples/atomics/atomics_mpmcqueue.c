@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdalign.h>
+#include <time.h>
+#include <threads.h>
+#include <stdatomic.h>
+
+// A bounded lock-free queue for many producers and many consumers
+//
+// The queue is a ring of cells. Each cell has a sequence number that
+// says whose turn it is to use it:
+//
+//   seq == pos       The cell is empty, and a producer at pos can fill it
+//   seq == pos + 1   The cell is full, and a consumer at pos can empty it
+//
+// Producers race to claim the next position with a compare-and-swap on
+// tail, and consumers do the same on head. Whoever wins owns the cell
+// until they bump its sequence number to hand it off.
+//
+// Nobody takes a lock unless the queue is empty. Then consumers go to
+// sleep on a condition variable, and producers only bother to signal
+// it if someone is actually waiting.
+
+#define CACHE_LINE 64
+#define SPIN_COUNT 1000  // Times to retry before sleeping on empty
+
+struct cell {
+    atomic_size_t seq;
+    int value;
+};
+
+struct mpmc {
+    struct cell *cells;
+    size_t mask;  // Size of the ring minus one
+
+    // Keep head and tail on their own cache lines so producers and
+    // consumers don't fight over the same one
+    alignas(CACHE_LINE) atomic_size_t tail;  // Next spot to push to
+    alignas(CACHE_LINE) atomic_size_t head;  // Next spot to pop from
+
+    alignas(CACHE_LINE) atomic_int waiters;  // Consumers asleep on cnd
+    mtx_t mtx;
+    cnd_t cnd;
+};
+
+// Set up a queue. size must be a power of 2.
+//
+// Returns 0 on success, -1 on failure.
+
+int mpmc_init(struct mpmc *q, size_t size)
+{
+    q->cells = malloc(size * sizeof *q->cells);
+
+    if (q->cells == NULL)
+        return -1;
+
+    for (size_t i = 0; i < size; i++)
+        atomic_init(&q->cells[i].seq, i);
+
+    q->mask = size - 1;
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->head, 0);
+    atomic_init(&q->waiters, 0);
+    mtx_init(&q->mtx, mtx_plain);
+    cnd_init(&q->cnd);
+
+    return 0;
+}
+
+void mpmc_destroy(struct mpmc *q)
+{
+    free(q->cells);
+    mtx_destroy(&q->mtx);
+    cnd_destroy(&q->cnd);
+}
+
+// Returns 1 if value was queued, or 0 if the queue is full
+int mpmc_try_push(struct mpmc *q, int value)
+{
+    size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    struct cell *c;
+
+    for (;;) {
+        c = &q->cells[pos & q->mask];
+
+        size_t seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            // Our turn--try to claim it. If someone beats us to it,
+            // pos gets updated and we go around again.
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos,
+                    pos + 1, memory_order_relaxed, memory_order_relaxed))
+                break;
+
+        } else if (diff < 0) {
+            return 0;  // A consumer hasn't emptied it yet: full
+
+        } else {
+            // Another producer got here first
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+
+    c->value = value;
+
+    // Hand the cell to the consumer at pos
+    atomic_store_explicit(&c->seq, pos + 1, memory_order_release);
+
+    return 1;
+}
+
+// Returns 1 and stores the value in *value, or 0 if the queue is empty
+int mpmc_try_pop(struct mpmc *q, int *value)
+{
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    struct cell *c;
+
+    for (;;) {
+        c = &q->cells[pos & q->mask];
+
+        size_t seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos,
+                    pos + 1, memory_order_relaxed, memory_order_relaxed))
+                break;
+
+        } else if (diff < 0) {
+            return 0;  // A producer hasn't filled it yet: empty
+
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+
+    *value = c->value;
+
+    // Hand the cell to the producer that comes around next time
+    atomic_store_explicit(&c->seq, pos + q->mask + 1, memory_order_release);
+
+    return 1;
+}
+
+// Push, waiting for room if the queue is full
+void mpmc_push(struct mpmc *q, int value)
+{
+    while (!mpmc_try_push(q, value))
+        thrd_yield();
+
+    // This fence pairs with the one in mpmc_pop(). Either we see the
+    // waiter, or the waiter sees our value.
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (atomic_load_explicit(&q->waiters, memory_order_relaxed) > 0) {
+        mtx_lock(&q->mtx);
+        cnd_signal(&q->cnd);
+        mtx_unlock(&q->mtx);
+    }
+}
+
+// Pop, sleeping if the queue is empty
+int mpmc_pop(struct mpmc *q)
+{
+    int value;
+
+    // Spin for a while first, since something's probably on the way
+    for (int i = 0; i < SPIN_COUNT; i++)
+        if (mpmc_try_pop(q, &value))
+            return value;
+
+    mtx_lock(&q->mtx);
+    atomic_fetch_add_explicit(&q->waiters, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    // Check again now that producers can see we're waiting
+    while (!mpmc_try_pop(q, &value))
+        cnd_wait(&q->cnd, &q->mtx);
+
+    atomic_fetch_sub_explicit(&q->waiters, 1, memory_order_relaxed);
+    mtx_unlock(&q->mtx);
+
+    return value;
+}
+
+// ---------------------------------------------------------------------
+// The mutex and condition variable version, for comparison. This is
+// the value buffer from threads_mutex.c, turned into a ring.
+
+struct locked {
+    int *values;
+    size_t size, head, count;
+    mtx_t mtx;
+    cnd_t not_empty, not_full;
+};
+
+int locked_init(struct locked *q, size_t size)
+{
+    if ((q->values = malloc(size * sizeof *q->values)) == NULL)
+        return -1;
+
+    q->size = size;
+    q->head = q->count = 0;
+    mtx_init(&q->mtx, mtx_plain);
+    cnd_init(&q->not_empty);
+    cnd_init(&q->not_full);
+
+    return 0;
+}
+
+void locked_destroy(struct locked *q)
+{
+    free(q->values);
+    mtx_destroy(&q->mtx);
+    cnd_destroy(&q->not_empty);
+    cnd_destroy(&q->not_full);
+}
+
+void locked_push(struct locked *q, int value)
+{
+    mtx_lock(&q->mtx);
+
+    while (q->count == q->size)
+        cnd_wait(&q->not_full, &q->mtx);
+
+    q->values[(q->head + q->count++) % q->size] = value;
+    cnd_signal(&q->not_empty);
+
+    mtx_unlock(&q->mtx);
+}
+
+int locked_pop(struct locked *q)
+{
+    mtx_lock(&q->mtx);
+
+    while (q->count == 0)
+        cnd_wait(&q->not_empty, &q->mtx);
+
+    int value = q->values[q->head];
+    q->head = (q->head + 1) % q->size;
+    q->count--;
+    cnd_signal(&q->not_full);
+
+    mtx_unlock(&q->mtx);
+
+    return value;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+#define QUEUE_SIZE 1024
+#define MAX_THREADS 64
+#define DONE -1  // Tells a consumer to quit
+
+struct mpmc mq;
+struct locked lq;
+int use_lockfree;
+long per_producer;
+atomic_llong total;  // Everything the consumers popped, added up
+
+int producer(void *arg)
+{
+    (void)arg;
+
+    for (long i = 0; i < per_producer; i++)
+        if (use_lockfree)
+            mpmc_push(&mq, i & 0xffff);
+        else
+            locked_push(&lq, i & 0xffff);
+
+    return 0;
+}
+
+int consumer(void *arg)
+{
+    (void)arg;
+
+    long long sum = 0;
+    int v;
+
+    while ((v = use_lockfree? mpmc_pop(&mq): locked_pop(&lq)) != DONE)
+        sum += v;
+
+    atomic_fetch_add(&total, sum);
+
+    return 0;
+}
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Run one round and return operations per second, or -1 if we
+// couldn't start all the threads
+double run(int producers, int consumers, long ops)
+{
+    thrd_t p[MAX_THREADS], c[MAX_THREADS];
+    int np, nc;  // How many actually started
+
+    per_producer = ops / producers;
+    atomic_store(&total, 0);
+
+    double t0 = now();
+
+    for (nc = 0; nc < consumers; nc++)
+        if (thrd_create(c + nc, consumer, NULL) != thrd_success)
+            break;
+
+    // No point in producing if the consumers aren't all there
+    for (np = 0; np < producers && nc == consumers; np++)
+        if (thrd_create(p + np, producer, NULL) != thrd_success)
+            break;
+
+    for (int i = 0; i < np; i++)
+        thrd_join(p[i], NULL);
+
+    // Everything's been pushed, so tell all the consumers to stop
+    for (int i = 0; i < nc; i++)
+        if (use_lockfree)
+            mpmc_push(&mq, DONE);
+        else
+            locked_push(&lq, DONE);
+
+    for (int i = 0; i < nc; i++)
+        thrd_join(c[i], NULL);
+
+    double t1 = now();
+
+    if (np < producers || nc < consumers) {
+        printf("Couldn't start threads\n");
+        return -1;
+    }
+
+    // Make sure nothing got lost or duplicated
+    long long expect = 0;
+
+    for (long i = 0; i < per_producer; i++)
+        expect += i & 0xffff;
+
+    if (atomic_load(&total) != expect * producers)
+        printf("MISMATCH: got %lld, expected %lld\n",
+            atomic_load(&total), expect * producers);
+
+    return per_producer * producers / (t1 - t0);
+}
+
+int main(int argc, char **argv)
+{
+    long ops = argc > 1? atol(argv[1]): 2000000;
+
+    int configs[][2] = {
+        {1, 1}, {2, 2}, {4, 4}, {8, 8}, {16, 16}, {1, 8}, {8, 1}
+    };
+
+    if (mpmc_init(&mq, QUEUE_SIZE) == -1 || locked_init(&lq, QUEUE_SIZE) == -1) {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    printf("%9s %9s %16s %16s\n", "producers", "consumers",
+        "mutex+cnd ops/s", "lock-free ops/s");
+
+    for (size_t i = 0; i < sizeof configs / sizeof *configs; i++) {
+        int np = configs[i][0], nc = configs[i][1];
+
+        use_lockfree = 0;
+        double locked_rate = run(np, nc, ops);
+
+        use_lockfree = 1;
+        double lockfree_rate = locked_rate < 0? -1: run(np, nc, ops);
+
+        if (lockfree_rate < 0)
+            return 1;
+
+        printf("%9d %9d %16.0f %16.0f\n", np, nc, locked_rate, lockfree_rate);
+    }
+
+    locked_destroy(&lq);
+    mpmc_destroy(&mq);
+}
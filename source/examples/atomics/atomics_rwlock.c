@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdalign.h>
+#include <time.h>
+#include <threads.h>
+#include <stdatomic.h>
+
+// A reader-writer lock for data that's read far more than it's written
+//
+// Lots of readers can hold the lock at the same time, but a writer gets
+// it all to itself. Writers win ties: once a writer shows up, new
+// readers wait until it's done, so a steady stream of readers can't
+// starve it.
+//
+// The reader count is split into shards, each on its own cache line,
+// and each thread always uses the same shard. If no writer is around,
+// a reader just bumps its shard's count and checks one flag--no mutex,
+// and no cache line shared with readers on other shards.
+//
+// Writers, and readers that have to wait for a writer, use the mutex
+// and condition variables.
+
+#define RW_SHARDS 16
+#define CACHE_LINE 64
+
+struct rw_shard {
+    alignas(CACHE_LINE) atomic_int readers;
+};
+
+struct rwlock {
+    struct rw_shard shards[RW_SHARDS];
+
+    // True while a writer holds the lock or is waiting for it
+    alignas(CACHE_LINE) atomic_bool writer;
+
+    mtx_t mtx;
+    cnd_t read_cnd;   // Readers wait here for writers to finish
+    cnd_t write_cnd;  // Writers wait here for other writers
+    cnd_t drain_cnd;  // A writer waits here for readers to leave
+    int writer_held;      // Protected by mtx
+    int writers_waiting;  // Protected by mtx
+};
+
+void rw_init(struct rwlock *l)
+{
+    for (int i = 0; i < RW_SHARDS; i++)
+        atomic_init(&l->shards[i].readers, 0);
+
+    atomic_init(&l->writer, false);
+    mtx_init(&l->mtx, mtx_plain);
+    cnd_init(&l->read_cnd);
+    cnd_init(&l->write_cnd);
+    cnd_init(&l->drain_cnd);
+    l->writer_held = 0;
+    l->writers_waiting = 0;
+}
+
+void rw_destroy(struct rwlock *l)
+{
+    mtx_destroy(&l->mtx);
+    cnd_destroy(&l->read_cnd);
+    cnd_destroy(&l->write_cnd);
+    cnd_destroy(&l->drain_cnd);
+}
+
+// Pick a shard for this thread the first time it reads
+static atomic_int next_shard;
+static thread_local int my_shard = -1;
+
+static struct rw_shard *get_shard(struct rwlock *l)
+{
+    if (my_shard == -1)
+        my_shard = atomic_fetch_add(&next_shard, 1) % RW_SHARDS;
+
+    return &l->shards[my_shard];
+}
+
+// Let a writer that's waiting for readers know one just left
+static void rw_reader_left(struct rwlock *l)
+{
+    if (atomic_load(&l->writer)) {
+        mtx_lock(&l->mtx);
+        cnd_signal(&l->drain_cnd);
+        mtx_unlock(&l->mtx);
+    }
+}
+
+void rw_read_lock(struct rwlock *l)
+{
+    struct rw_shard *s = get_shard(l);
+
+    for (;;) {
+        // Fast path: say we're reading, then make sure no writer is.
+        // These are both seq_cst, and so is the writer setting its
+        // flag and then counting readers, so at least one of us sees
+        // the other.
+        atomic_fetch_add(&s->readers, 1);
+
+        if (!atomic_load(&l->writer))
+            return;
+
+        // A writer is here or on its way. Back out and wait for it.
+        atomic_fetch_sub(&s->readers, 1);
+        rw_reader_left(l);
+
+        mtx_lock(&l->mtx);
+
+        while (atomic_load(&l->writer))
+            cnd_wait(&l->read_cnd, &l->mtx);
+
+        mtx_unlock(&l->mtx);
+    }
+}
+
+void rw_read_unlock(struct rwlock *l)
+{
+    atomic_fetch_sub(&get_shard(l)->readers, 1);
+    rw_reader_left(l);
+}
+
+static int rw_reader_count(struct rwlock *l)
+{
+    int total = 0;
+
+    for (int i = 0; i < RW_SHARDS; i++)
+        total += atomic_load(&l->shards[i].readers);
+
+    return total;
+}
+
+void rw_write_lock(struct rwlock *l)
+{
+    mtx_lock(&l->mtx);
+
+    // Raise the flag right away so new readers hold off
+    l->writers_waiting++;
+    atomic_store(&l->writer, true);
+
+    while (l->writer_held)
+        cnd_wait(&l->write_cnd, &l->mtx);
+
+    l->writers_waiting--;
+    l->writer_held = 1;
+
+    // Wait for the readers that got in before us
+    while (rw_reader_count(l) > 0)
+        cnd_wait(&l->drain_cnd, &l->mtx);
+
+    mtx_unlock(&l->mtx);
+}
+
+void rw_write_unlock(struct rwlock *l)
+{
+    mtx_lock(&l->mtx);
+
+    l->writer_held = 0;
+
+    if (l->writers_waiting > 0) {
+        // Another writer goes next, and readers keep waiting
+        cnd_signal(&l->write_cnd);
+    } else {
+        atomic_store(&l->writer, false);
+        cnd_broadcast(&l->read_cnd);
+    }
+
+    mtx_unlock(&l->mtx);
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+#define MAX_THREADS 64
+
+// Shared data we read and occasionally write
+struct {
+    int values[8];
+} shared = {{0, 1, 2, 3, 4, 5, 6, 7}};
+
+struct rwlock rwl;
+mtx_t mtx;
+
+int use_rwlock;
+int write_every;  // 0 means never write
+atomic_bool go, stop;
+long ops[MAX_THREADS];
+atomic_int torn;  // Reads that saw a half-finished write
+
+// Readers check that all the values are consistent: each one is the
+// one before plus 1
+static int check_shared(void)
+{
+    for (int i = 1; i < 8; i++)
+        if (shared.values[i] != shared.values[0] + i)
+            return 0;
+
+    return 1;
+}
+
+static void write_shared(void)
+{
+    for (int i = 0; i < 8; i++)
+        shared.values[i]++;
+}
+
+int run(void *arg)
+{
+    int id = *(int*)arg;
+    long count = 0;
+
+    while (!atomic_load(&go))
+        thrd_yield();
+
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        int write = write_every != 0 && count % write_every == 0;
+
+        if (use_rwlock) {
+            if (write) {
+                rw_write_lock(&rwl);
+                write_shared();
+                rw_write_unlock(&rwl);
+            } else {
+                rw_read_lock(&rwl);
+                if (!check_shared())
+                    atomic_fetch_add(&torn, 1);
+                rw_read_unlock(&rwl);
+            }
+        } else {
+            mtx_lock(&mtx);
+            if (write)
+                write_shared();
+            else if (!check_shared())
+                atomic_fetch_add(&torn, 1);
+            mtx_unlock(&mtx);
+        }
+
+        count++;
+    }
+
+    ops[id] = count;
+
+    return 0;
+}
+
+double bench(int rwlock, int nthreads, double seconds)
+{
+    thrd_t t[MAX_THREADS];
+    int id[MAX_THREADS];
+
+    use_rwlock = rwlock;
+    atomic_store(&go, false);
+    atomic_store(&stop, false);
+
+    for (int i = 0; i < nthreads; i++) {
+        id[i] = i;
+        thrd_create(t + i, run, id + i);
+    }
+
+    atomic_store(&go, true);
+
+    thrd_sleep(&(struct timespec){.tv_sec=seconds,
+        .tv_nsec=(seconds - (long)seconds) * 1e9}, NULL);
+
+    atomic_store(&stop, true);
+
+    long total = 0;
+
+    for (int i = 0; i < nthreads; i++) {
+        thrd_join(t[i], NULL);
+        total += ops[i];
+    }
+
+    return total / seconds;
+}
+
+int main(int argc, char **argv)
+{
+    int max_threads = argc > 1? atoi(argv[1]): 32;
+    double seconds = argc > 2? atof(argv[2]): 0.5;
+
+    if (max_threads > MAX_THREADS)
+        max_threads = MAX_THREADS;
+
+    rw_init(&rwl);
+    mtx_init(&mtx, mtx_plain);
+
+    printf("%7s %17s %17s %17s %17s\n", "", "100% reads", "",
+        "99% reads", "");
+    printf("%7s %17s %17s %17s %17s\n", "threads",
+        "mtx_lock ops/s", "rwlock ops/s", "mtx_lock ops/s", "rwlock ops/s");
+
+    for (int n = 1; n <= max_threads; n *= 2) {
+        write_every = 0;
+        double m100 = bench(0, n, seconds);
+        double r100 = bench(1, n, seconds);
+
+        write_every = 100;
+        double m99 = bench(0, n, seconds);
+        double r99 = bench(1, n, seconds);
+
+        printf("%7d %17.0f %17.0f %17.0f %17.0f\n", n, m100, r100, m99, r99);
+    }
+
+    if (atomic_load(&torn) > 0)
+        printf("ERROR: %d reads saw a partial write\n", atomic_load(&torn));
+
+    mtx_destroy(&mtx);
+    rw_destroy(&rwl);
+}
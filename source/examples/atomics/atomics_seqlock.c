@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <threads.h>
+#include <stdatomic.h>
+
+// A seqlock for small structs
+//
+// _Atomic(struct point) looks great, but unless the struct is tiny, it
+// usually isn't lock-free (see atomics_structlockfree.c). Every load
+// quietly grabs a lock inside the atomics library.
+//
+// A seqlock lets readers read without ever taking a lock. There's a
+// sequence number next to the data. A writer bumps it to an odd number,
+// writes, then bumps it to the next even number. A reader grabs the
+// sequence number, copies the data, and checks the sequence number
+// again. If it's odd, or it changed, a write got in the way, so the
+// reader tries again.
+//
+// The data is kept in relaxed atomic words so that a reader racing a
+// writer isn't undefined behavior--it just gets a copy that it throws
+// away.
+
+#define SEQLOCK_MAX_SIZE 64  // Biggest struct we'll hold, in bytes
+#define SEQLOCK_WORDS (SEQLOCK_MAX_SIZE / sizeof(uint64_t))
+
+struct seqlock {
+    atomic_uint seq;
+    size_t size;
+    _Atomic uint64_t words[SEQLOCK_WORDS];
+};
+
+// Set up a seqlock holding a copy of the size bytes at data
+//
+// Returns 0 on success, -1 if it's too big.
+
+int seqlock_init(struct seqlock *s, const void *data, size_t size)
+{
+    uint64_t w[SEQLOCK_WORDS] = {0};
+
+    if (size > SEQLOCK_MAX_SIZE)
+        return -1;
+
+    memcpy(w, data, size);
+
+    atomic_init(&s->seq, 0);
+    s->size = size;
+
+    for (size_t i = 0; i < SEQLOCK_WORDS; i++)
+        atomic_init(&s->words[i], w[i]);
+
+    return 0;
+}
+
+// Copy the data out into out. Never blocks.
+void seqlock_read(struct seqlock *s, void *out)
+{
+    uint64_t w[SEQLOCK_WORDS];
+    size_t nwords = (s->size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    unsigned seq0, seq1;
+
+    do {
+        seq0 = atomic_load_explicit(&s->seq, memory_order_acquire);
+
+        for (size_t i = 0; i < nwords; i++)
+            w[i] = atomic_load_explicit(&s->words[i], memory_order_relaxed);
+
+        // Keep the data loads from moving down past the second load of
+        // the sequence number
+        atomic_thread_fence(memory_order_acquire);
+
+        seq1 = atomic_load_explicit(&s->seq, memory_order_relaxed);
+
+    } while ((seq0 & 1) || seq0 != seq1);
+
+    memcpy(out, w, s->size);
+}
+
+// Copy new data in from data. Writers wait for each other, but never
+// for readers.
+void seqlock_write(struct seqlock *s, const void *data)
+{
+    uint64_t w[SEQLOCK_WORDS] = {0};
+    size_t nwords = (s->size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    memcpy(w, data, s->size);
+
+    // Claim it by moving seq from even to odd
+    unsigned seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+
+    for (;;) {
+        if ((seq & 1) == 0 &&
+            atomic_compare_exchange_weak_explicit(&s->seq, &seq, seq + 1,
+                memory_order_relaxed, memory_order_relaxed))
+            break;
+
+        if (seq & 1) {
+            thrd_yield();  // Another writer's in there
+            seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+        }
+    }
+
+    // Keep the data stores from moving up before the odd seq
+    atomic_thread_fence(memory_order_release);
+
+    for (size_t i = 0; i < nwords; i++)
+        atomic_store_explicit(&s->words[i], w[i], memory_order_relaxed);
+
+    // And this release keeps them from moving down after the even one
+    atomic_store_explicit(&s->seq, seq + 2, memory_order_release);
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+#define MAX_THREADS 64
+
+struct point {
+    double x, y, z;
+};
+
+struct seqlock sl;
+_Atomic(struct point) ap;
+
+int use_seqlock;
+atomic_bool go, stop;
+long reads[MAX_THREADS];
+atomic_long torn;  // Reads that saw half of one write and half another
+
+int writer(void *arg)
+{
+    (void)arg;
+
+    double i = 0;
+
+    while (!atomic_load(&go))
+        thrd_yield();
+
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        struct point p = {i, i * 2, i * 3};
+
+        if (use_seqlock)
+            seqlock_write(&sl, &p);
+        else
+            atomic_store(&ap, p);
+
+        i++;
+    }
+
+    return 0;
+}
+
+int reader(void *arg)
+{
+    int id = *(int*)arg;
+    long count = 0;
+    struct point p;
+
+    while (!atomic_load(&go))
+        thrd_yield();
+
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        if (use_seqlock)
+            seqlock_read(&sl, &p);
+        else
+            p = atomic_load(&ap);
+
+        if (p.y != p.x * 2 || p.z != p.x * 3)
+            atomic_fetch_add(&torn, 1);
+
+        count++;
+    }
+
+    reads[id] = count;
+
+    return 0;
+}
+
+double bench(int seqlock, int nreaders, double seconds)
+{
+    thrd_t t[MAX_THREADS], w;
+    int id[MAX_THREADS];
+
+    use_seqlock = seqlock;
+    atomic_store(&go, false);
+    atomic_store(&stop, false);
+
+    thrd_create(&w, writer, NULL);
+
+    for (int i = 0; i < nreaders; i++) {
+        id[i] = i;
+        thrd_create(t + i, reader, id + i);
+    }
+
+    atomic_store(&go, true);
+
+    thrd_sleep(&(struct timespec){.tv_sec=seconds,
+        .tv_nsec=(seconds - (long)seconds) * 1e9}, NULL);
+
+    atomic_store(&stop, true);
+
+    thrd_join(w, NULL);
+
+    long total = 0;
+
+    for (int i = 0; i < nreaders; i++) {
+        thrd_join(t[i], NULL);
+        total += reads[i];
+    }
+
+    return total / seconds;
+}
+
+int main(int argc, char **argv)
+{
+    int max_threads = argc > 1? atoi(argv[1]): 32;
+    double seconds = argc > 2? atof(argv[2]): 0.5;
+
+    if (max_threads > MAX_THREADS)
+        max_threads = MAX_THREADS;
+
+    struct point zero = {0, 0, 0};
+
+    seqlock_init(&sl, &zero, sizeof zero);
+    atomic_init(&ap, zero);
+
+    printf("_Atomic(struct point) is lock free: %s\n",
+        atomic_is_lock_free(&ap)? "yes": "no");
+
+    printf("%7s %20s %20s\n", "readers", "_Atomic reads/s", "seqlock reads/s");
+
+    for (int n = 1; n <= max_threads; n *= 2) {
+        double a = bench(0, n, seconds);
+        double s = bench(1, n, seconds);
+
+        printf("%7d %20.0f %20.0f\n", n, a, s);
+    }
+
+    if (atomic_load(&torn) > 0)
+        printf("ERROR: %ld torn reads\n", atomic_load(&torn));
+}
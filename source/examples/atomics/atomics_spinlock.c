@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <threads.h>
+#include <stdatomic.h>
+
+// Fairer, friendlier spinlocks
+//
+// Spinning on atomic_flag_test_and_set() like in the reference page
+// example has two problems when lots of threads want the lock:
+//
+// * Every spinning thread keeps writing to the same cache line, so it
+//   bounces between the cores the whole time.
+// * Whoever happens to win the next test-and-set gets the lock, so
+//   some threads can wait a very long time.
+//
+// A ticket lock fixes the fairness: everyone takes a number, and the
+// lock goes to the numbers in order. Waiters only read while they spin.
+//
+// An MCS lock also fixes the cache traffic. Waiters line up in a linked
+// list, and each one spins on a flag in its own node. The thread that
+// unlocks only touches the next waiter's flag.
+//
+// Both back off exponentially while they spin, with a pause hint for
+// the CPU, and start calling thrd_yield() if the wait gets long.
+
+// Tell the CPU we're in a spin loop, if we know how
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_PAUSE() __builtin_ia32_pause()
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define CPU_PAUSE() __asm__ __volatile__("yield")
+#else
+#define CPU_PAUSE() ((void)0)
+#endif
+
+#define BACKOFF_MAX 1024           // Most pauses in a row
+#define BACKOFF_YIELD_AFTER 16384  // Pauses before we start yielding
+
+struct backoff {
+    int spins;  // How many pauses next time
+    int total;  // How many so far
+};
+
+#define BACKOFF_INIT {.spins=1, .total=0}
+
+void backoff_wait(struct backoff *b)
+{
+    // We've been at this a while. Let someone else run--maybe even the
+    // thread holding the lock.
+    if (b->total >= BACKOFF_YIELD_AFTER) {
+        thrd_yield();
+        return;
+    }
+
+    for (int i = 0; i < b->spins; i++)
+        CPU_PAUSE();
+
+    b->total += b->spins;
+
+    if (b->spins < BACKOFF_MAX)
+        b->spins *= 2;
+}
+
+// Ticket lock
+
+struct ticket_lock {
+    atomic_uint next;   // The next ticket to hand out
+    atomic_uint owner;  // The ticket that holds the lock
+};
+
+#define TICKET_LOCK_INIT {0, 0}
+
+void ticket_lock(struct ticket_lock *l)
+{
+    unsigned my = atomic_fetch_add_explicit(&l->next, 1, memory_order_relaxed);
+    struct backoff b = BACKOFF_INIT;
+
+    while (atomic_load_explicit(&l->owner, memory_order_acquire) != my)
+        backoff_wait(&b);
+}
+
+void ticket_unlock(struct ticket_lock *l)
+{
+    // Only the owner writes this, so a plain load is fine
+    unsigned owner = atomic_load_explicit(&l->owner, memory_order_relaxed);
+
+    atomic_store_explicit(&l->owner, owner + 1, memory_order_release);
+}
+
+// MCS lock
+//
+// Each thread brings its own node to lock(), and has to pass the same
+// one to unlock(). It can live on the stack.
+
+struct mcs_node {
+    _Atomic(struct mcs_node *) next;
+    atomic_bool locked;
+};
+
+struct mcs_lock {
+    _Atomic(struct mcs_node *) tail;  // The last thread in line
+};
+
+#define MCS_LOCK_INIT {NULL}
+
+void mcs_lock(struct mcs_lock *l, struct mcs_node *node)
+{
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&node->locked, true, memory_order_relaxed);
+
+    // Get in line
+    struct mcs_node *prev = atomic_exchange_explicit(&l->tail, node,
+        memory_order_acq_rel);
+
+    if (prev == NULL)
+        return;  // Nobody was in line, so it's ours
+
+    // Let the thread ahead of us know where we are, then wait for it
+    // to hand the lock over
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+
+    struct backoff b = BACKOFF_INIT;
+
+    while (atomic_load_explicit(&node->locked, memory_order_acquire))
+        backoff_wait(&b);
+}
+
+void mcs_unlock(struct mcs_lock *l, struct mcs_node *node)
+{
+    struct mcs_node *next = atomic_load_explicit(&node->next,
+        memory_order_acquire);
+
+    if (next == NULL) {
+        // If we're still the tail, nobody's waiting
+        struct mcs_node *expected = node;
+
+        if (atomic_compare_exchange_strong_explicit(&l->tail, &expected,
+                NULL, memory_order_release, memory_order_relaxed))
+            return;
+
+        // Someone just got in line but hasn't linked up yet
+        while ((next = atomic_load_explicit(&node->next,
+                memory_order_acquire)) == NULL)
+            CPU_PAUSE();
+    }
+
+    atomic_store_explicit(&next->locked, false, memory_order_release);
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+#define MAX_THREADS 64
+
+enum lock_type { FLAG, TICKET, MCS };
+
+char *lock_names[] = {"atomic_flag", "ticket", "MCS"};
+
+enum lock_type lock_type;
+atomic_flag flag_lock = ATOMIC_FLAG_INIT;
+struct ticket_lock tlock = TICKET_LOCK_INIT;
+struct mcs_lock mlock = MCS_LOCK_INIT;
+
+atomic_bool go, stop;
+long shared_counter;           // Protected by the lock
+long acquisitions[MAX_THREADS];  // Per-thread count
+
+int run(void *arg)
+{
+    int id = *(int*)arg;
+    long count = 0;
+    struct mcs_node node;
+
+    // Wait for everyone to be ready, so nobody gets a head start
+    while (!atomic_load(&go))
+        thrd_yield();
+
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        switch (lock_type) {
+            case FLAG:
+                while (atomic_flag_test_and_set(&flag_lock));
+                shared_counter++;
+                atomic_flag_clear(&flag_lock);
+                break;
+
+            case TICKET:
+                ticket_lock(&tlock);
+                shared_counter++;
+                ticket_unlock(&tlock);
+                break;
+
+            case MCS:
+                mcs_lock(&mlock, &node);
+                shared_counter++;
+                mcs_unlock(&mlock, &node);
+                break;
+        }
+
+        count++;
+    }
+
+    acquisitions[id] = count;
+
+    return 0;
+}
+
+int compar_long(const void *elem0, const void *elem1)
+{
+    const long *x = elem0, *y = elem1;
+
+    return (*x > *y) - (*x < *y);
+}
+
+void bench(enum lock_type type, int nthreads, double seconds)
+{
+    thrd_t t[MAX_THREADS];
+    int id[MAX_THREADS];
+
+    lock_type = type;
+    shared_counter = 0;
+    atomic_store(&go, false);
+    atomic_store(&stop, false);
+
+    for (int i = 0; i < nthreads; i++) {
+        id[i] = i;
+        thrd_create(t + i, run, id + i);
+    }
+
+    atomic_store(&go, true);
+
+    thrd_sleep(&(struct timespec){.tv_sec=seconds,
+        .tv_nsec=(seconds - (long)seconds) * 1e9}, NULL);
+
+    atomic_store(&stop, true);
+
+    for (int i = 0; i < nthreads; i++)
+        thrd_join(t[i], NULL);
+
+    // Fairness: how each thread's share compares to an even split
+    long sorted[MAX_THREADS], total = 0;
+
+    for (int i = 0; i < nthreads; i++) {
+        sorted[i] = acquisitions[i];
+        total += acquisitions[i];
+    }
+
+    qsort(sorted, nthreads, sizeof *sorted, compar_long);
+
+    double mean = (double)total / nthreads;
+
+    printf("%-12s %3d %14.0f   %5.0f%% %5.0f%% %5.0f%% %5.0f%% %5.0f%%  %s\n",
+        lock_names[type], nthreads, total / seconds,
+        100 * sorted[0] / mean,
+        100 * sorted[nthreads / 10] / mean,
+        100 * sorted[nthreads / 2] / mean,
+        100 * sorted[nthreads * 9 / 10] / mean,
+        100 * sorted[nthreads - 1] / mean,
+        shared_counter == total? "ok": "MISMATCH");
+}
+
+int main(int argc, char **argv)
+{
+    int max_threads = argc > 1? atoi(argv[1]): 32;
+    double seconds = argc > 2? atof(argv[2]): 0.5;
+
+    if (max_threads > MAX_THREADS)
+        max_threads = MAX_THREADS;
+
+    printf("Per-thread acquisitions as a percent of the mean:\n");
+    printf("%-12s %3s %14s   %6s %6s %6s %6s %6s\n",
+        "lock", "thr", "acquires/s", "min", "p10", "p50", "p90", "max");
+
+    for (int n = 1; n <= max_threads; n *= 2)
+        for (enum lock_type type = FLAG; type <= MCS; type++)
+            bench(type, n, seconds);
+}
@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdalign.h>
+#include <time.h>
+#include <threads.h>
+#include <stdatomic.h>
+
+// A counter that lots of threads can bump without fighting
+//
+// If every thread does atomic_fetch_add() on the same atomic_int, the
+// cache line holding it has to bounce from core to core on every add.
+//
+// A striped counter gives each thread its own slot, padded out to a
+// whole cache line with alignas so no two slots share one. Adds go to
+// the thread's own slot. Every so often a slot's count is folded into a
+// shared total, so there's a cheap approximate value to read.
+//
+// striped_read() just loads that total. It can be behind by up to
+// STRIPE_FLUSH for every slot.
+//
+// striped_sum() adds up the total and every slot. Once the adding
+// threads are done (say, after thrd_join()), it's exact.
+
+#define STRIPES 64
+#define STRIPE_FLUSH 1024  // Fold a slot into the total this often
+#define CACHE_LINE 64
+
+struct stripe {
+    alignas(CACHE_LINE) atomic_long pending;  // Not yet in the total
+};
+
+struct striped_counter {
+    struct stripe stripes[STRIPES];
+    alignas(CACHE_LINE) atomic_long total;
+};
+
+void striped_init(struct striped_counter *c)
+{
+    for (int i = 0; i < STRIPES; i++)
+        atomic_init(&c->stripes[i].pending, 0);
+
+    atomic_init(&c->total, 0);
+}
+
+// Each thread picks its slot the first time it adds. If there are more
+// threads than slots, some will share, which is still correct, just
+// slower.
+static atomic_int next_stripe;
+static thread_local int my_stripe = -1;
+
+void striped_add(struct striped_counter *c, long n)
+{
+    if (my_stripe == -1)
+        my_stripe = atomic_fetch_add(&next_stripe, 1) % STRIPES;
+
+    struct stripe *s = &c->stripes[my_stripe];
+
+    long pending = atomic_fetch_add_explicit(&s->pending, n,
+        memory_order_relaxed) + n;
+
+    // Time to move this slot's count over to the total?
+    if (pending >= STRIPE_FLUSH || pending <= -STRIPE_FLUSH) {
+        pending = atomic_exchange_explicit(&s->pending, 0,
+            memory_order_relaxed);
+        atomic_fetch_add_explicit(&c->total, pending, memory_order_relaxed);
+    }
+}
+
+// Cheap, but might be a little behind
+long striped_read(struct striped_counter *c)
+{
+    return atomic_load_explicit(&c->total, memory_order_relaxed);
+}
+
+// Exact once nobody is adding
+long striped_sum(struct striped_counter *c)
+{
+    long sum = atomic_load(&c->total);
+
+    for (int i = 0; i < STRIPES; i++)
+        sum += atomic_load(&c->stripes[i].pending);
+
+    return sum;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+#define MAX_THREADS 64
+
+atomic_long single;
+struct striped_counter striped;
+
+int use_striped;
+long adds_per_thread;
+atomic_bool go;
+
+int run(void *arg)
+{
+    (void)arg;
+
+    while (!atomic_load(&go))
+        thrd_yield();
+
+    if (use_striped)
+        for (long i = 0; i < adds_per_thread; i++)
+            striped_add(&striped, 1);
+    else
+        for (long i = 0; i < adds_per_thread; i++)
+            atomic_fetch_add_explicit(&single, 1, memory_order_relaxed);
+
+    return 0;
+}
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double bench(int striped_counter, int nthreads)
+{
+    thrd_t t[MAX_THREADS];
+
+    use_striped = striped_counter;
+    atomic_store(&go, false);
+
+    for (int i = 0; i < nthreads; i++)
+        thrd_create(t + i, run, NULL);
+
+    double t0 = now();
+    atomic_store(&go, true);
+
+    for (int i = 0; i < nthreads; i++)
+        thrd_join(t[i], NULL);
+
+    double t1 = now();
+
+    return adds_per_thread * nthreads / (t1 - t0);
+}
+
+int main(int argc, char **argv)
+{
+    adds_per_thread = argc > 1? atol(argv[1]): 10000000;
+    int max_threads = argc > 2? atoi(argv[2]): 64;
+
+    if (max_threads > MAX_THREADS)
+        max_threads = MAX_THREADS;
+
+    printf("%7s %18s %18s   %s\n", "threads", "atomic_fetch_add/s",
+        "striped_add/s", "striped_read, striped_sum");
+
+    for (int n = 1; n <= max_threads; n *= 2) {
+        atomic_store(&single, 0);
+        striped_init(&striped);
+
+        double a = bench(0, n);
+        double s = bench(1, n);
+
+        long expect = adds_per_thread * n;
+
+        printf("%7d %18.0f %18.0f   %ld, %ld %s\n", n, a, s,
+            striped_read(&striped), striped_sum(&striped),
+            striped_sum(&striped) == expect &&
+            atomic_load(&single) == expect? "": "MISMATCH");
+    }
+}
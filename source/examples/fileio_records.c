@@ -0,0 +1,567 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+// A binary record file format
+//
+// fwrite() of an array of structs is fast, but the file doesn't say
+// what's in it. Read it back on a machine with different struct
+// padding or a different byte order, and you get garbage with no
+// warning.
+//
+// This puts a small header up front with the record size, the record
+// count, the byte order, and a schema listing each field's type,
+// offset, and name. The reader checks the header against the schema the
+// program expects, and swaps bytes if the file came from a machine with
+// the other byte order.
+//
+// The records themselves can be stored two ways:
+//
+// REC_AOS: an array of structs, just like fwrite() of the array.
+//
+// REC_SOA: a struct of arrays--all the first fields, then all the
+//          second fields, and so on. If you only want one column, you
+//          only have to read that column from the disk.
+//
+// Either way, rec_read() fills a caller's buffer with whole records,
+// and rec_read_column() fills it with one field's values, a chunk at a
+// time.
+//
+// The header is always written a byte at a time in little-endian order,
+// so it reads the same everywhere. The record data is written in the
+// writer's native byte order, and the header says which that was.
+
+enum rec_type {
+    REC_I8, REC_U8, REC_I16, REC_U16, REC_I32, REC_U32,
+    REC_I64, REC_U64, REC_F32, REC_F64,
+};
+
+static const size_t rec_type_size[] = {1, 1, 2, 2, 4, 4, 8, 8, 4, 8};
+
+enum rec_layout {
+    REC_AOS,
+    REC_SOA,
+};
+
+#define REC_NAME_LEN 12  // Including the NUL
+#define REC_MAX_FIELDS 255
+
+struct rec_field {
+    const char *name;
+    enum rec_type type;
+    size_t offset;
+};
+
+struct rec_schema {
+    size_t size;  // sizeof the struct
+    int nfields;
+    const struct rec_field *fields;
+};
+
+// Handy for building a schema:
+//
+//     REC_FIELD(struct sample, x, REC_F64)
+
+#define REC_FIELD(T, member, type) {#member, (type), offsetof(T, member)}
+
+// The header on disk:
+//
+//     4 bytes  magic "BREC"
+//     1 byte   version
+//     1 byte   byte order of the records: 'L' or 'B'
+//     1 byte   layout: 0 for REC_AOS, 1 for REC_SOA
+//     1 byte   field count
+//     4 bytes  record size
+//     8 bytes  record count
+//
+// followed by 16 bytes for each field:
+//
+//     1 byte   type
+//     1 byte   unused
+//     2 bytes  offset in the record
+//     12 bytes name, NUL-padded
+
+#define REC_MAGIC "BREC"
+#define REC_VERSION 1
+#define REC_HEADER_SIZE 20
+#define REC_FIELD_SIZE 16
+
+// How many values to move at a time when we have to shuffle them
+#define REC_SCRATCH 4096
+
+struct rec_reader {
+    FILE *fp;
+    const struct rec_schema *schema;
+    enum rec_layout layout;
+    int swap;             // File byte order isn't ours
+    uint64_t count;       // Records in the file
+    uint64_t pos;         // Next record to read
+    long data_start;      // Where the records start in the file
+    long column_start[REC_MAX_FIELDS];  // For REC_SOA
+};
+
+static char native_order(void)
+{
+    uint16_t x = 1;
+
+    return *(unsigned char *)&x == 1? 'L': 'B';
+}
+
+// Little-endian helpers for the header
+
+static void put_le(unsigned char *p, uint64_t v, int n)
+{
+    for (int i = 0; i < n; i++)
+        p[i] = v >> (i * 8);
+}
+
+static uint64_t get_le(const unsigned char *p, int n)
+{
+    uint64_t v = 0;
+
+    for (int i = n - 1; i >= 0; i--)
+        v = v << 8 | p[i];
+
+    return v;
+}
+
+static void swap_bytes(unsigned char *p, size_t n)
+{
+    for (size_t i = 0; i < n / 2; i++) {
+        unsigned char t = p[i];
+        p[i] = p[n - 1 - i];
+        p[n - 1 - i] = t;
+    }
+}
+
+// Swap every field in count records
+static void swap_records(const struct rec_schema *s, void *recs, size_t count)
+{
+    unsigned char *r = recs;
+
+    for (size_t i = 0; i < count; i++, r += s->size)
+        for (int f = 0; f < s->nfields; f++)
+            swap_bytes(r + s->fields[f].offset,
+                rec_type_size[s->fields[f].type]);
+}
+
+// Swap count values of one size
+static void swap_values(void *values, size_t size, size_t count)
+{
+    unsigned char *v = values;
+
+    if (size > 1)
+        for (size_t i = 0; i < count; i++, v += size)
+            swap_bytes(v, size);
+}
+
+// Write count records from recs to fp, header and all
+//
+// Returns 0 on success, -1 on failure. That includes schemas that won't
+// fit in the header: records bigger than 4 GB, or a field more than
+// 64 KB into the record.
+
+int rec_write(FILE *fp, const struct rec_schema *s, enum rec_layout layout,
+              const void *recs, uint64_t count)
+{
+    unsigned char h[REC_HEADER_SIZE], f[REC_FIELD_SIZE];
+
+    if (s->nfields < 1 || s->nfields > REC_MAX_FIELDS ||
+        s->size > 0xffffffff)
+        return -1;
+
+    // Check them all before we write anything
+    for (int i = 0; i < s->nfields; i++)
+        if (s->fields[i].offset > 0xffff)
+            return -1;
+
+    memcpy(h, REC_MAGIC, 4);
+    h[4] = REC_VERSION;
+    h[5] = native_order();
+    h[6] = layout;
+    h[7] = s->nfields;
+    put_le(h + 8, s->size, 4);
+    put_le(h + 12, count, 8);
+
+    if (fwrite(h, sizeof h, 1, fp) != 1)
+        return -1;
+
+    for (int i = 0; i < s->nfields; i++) {
+        memset(f, 0, sizeof f);
+        f[0] = s->fields[i].type;
+        put_le(f + 2, s->fields[i].offset, 2);
+        strncpy((char *)f + 4, s->fields[i].name, REC_NAME_LEN - 1);
+
+        if (fwrite(f, sizeof f, 1, fp) != 1)
+            return -1;
+    }
+
+    if (layout == REC_AOS)
+        return fwrite(recs, s->size, count, fp) == count? 0: -1;
+
+    // REC_SOA: gather up each field into a column, a piece at a time
+    const unsigned char *r = recs;
+    unsigned char scratch[REC_SCRATCH * sizeof(uint64_t)];
+
+    for (int i = 0; i < s->nfields; i++) {
+        size_t fsize = rec_type_size[s->fields[i].type];
+        size_t offset = s->fields[i].offset;
+
+        for (uint64_t done = 0; done < count;) {
+            size_t n = count - done < REC_SCRATCH? count - done: REC_SCRATCH;
+
+            for (size_t j = 0; j < n; j++)
+                memcpy(scratch + j * fsize,
+                    r + (done + j) * s->size + offset, fsize);
+
+            if (fwrite(scratch, fsize, n, fp) != n)
+                return -1;
+
+            done += n;
+        }
+    }
+
+    return 0;
+}
+
+// Read the header from fp and check it against schema s
+//
+// Returns 0 on success, -1 if it can't be read or doesn't match.
+
+int rec_open(struct rec_reader *r, FILE *fp, const struct rec_schema *s)
+{
+    unsigned char h[REC_HEADER_SIZE], f[REC_FIELD_SIZE];
+
+    if (fread(h, sizeof h, 1, fp) != 1)
+        return -1;
+
+    if (memcmp(h, REC_MAGIC, 4) != 0 || h[4] != REC_VERSION)
+        return -1;
+
+    if ((h[5] != 'L' && h[5] != 'B') || h[6] > REC_SOA)
+        return -1;
+
+    if (h[7] != s->nfields || get_le(h + 8, 4) != s->size)
+        return -1;
+
+    for (int i = 0; i < s->nfields; i++) {
+        if (fread(f, sizeof f, 1, fp) != 1)
+            return -1;
+
+        if (f[0] != s->fields[i].type ||
+            get_le(f + 2, 2) != s->fields[i].offset ||
+            strncmp((char *)f + 4, s->fields[i].name, REC_NAME_LEN - 1) != 0)
+            return -1;
+    }
+
+    r->fp = fp;
+    r->schema = s;
+    r->swap = h[5] != native_order();
+    r->layout = h[6];
+    r->count = get_le(h + 12, 8);
+    r->pos = 0;
+    r->data_start = ftell(fp);
+
+    long start = r->data_start;
+
+    for (int i = 0; i < s->nfields; i++) {
+        r->column_start[i] = start;
+        start += rec_type_size[s->fields[i].type] * r->count;
+    }
+
+    return 0;
+}
+
+// Start reading again from record index
+int rec_seek(struct rec_reader *r, uint64_t index)
+{
+    if (index > r->count)
+        return -1;
+
+    r->pos = index;
+
+    if (r->layout == REC_AOS)
+        return fseek(r->fp, r->data_start + index * r->schema->size, SEEK_SET);
+
+    return 0;
+}
+
+// Read up to n whole records into recs
+//
+// Returns the number read, which is 0 at the end of the file.
+
+size_t rec_read(struct rec_reader *r, void *recs, size_t n)
+{
+    const struct rec_schema *s = r->schema;
+
+    if (n > r->count - r->pos)
+        n = r->count - r->pos;
+
+    if (r->layout == REC_AOS) {
+        n = fread(recs, s->size, n, r->fp);
+
+        if (r->swap)
+            swap_records(s, recs, n);
+
+        r->pos += n;
+
+        return n;
+    }
+
+    // REC_SOA: pick up each column and scatter it into the records
+    unsigned char *out = recs;
+    unsigned char scratch[REC_SCRATCH * sizeof(uint64_t)];
+
+    for (int i = 0; i < s->nfields; i++) {
+        size_t fsize = rec_type_size[s->fields[i].type];
+        size_t offset = s->fields[i].offset;
+
+        if (fseek(r->fp, r->column_start[i] + r->pos * fsize, SEEK_SET) != 0)
+            return 0;
+
+        for (size_t done = 0; done < n;) {
+            size_t m = n - done < REC_SCRATCH? n - done: REC_SCRATCH;
+
+            if (fread(scratch, fsize, m, r->fp) != m)
+                return 0;
+
+            if (r->swap)
+                swap_values(scratch, fsize, m);
+
+            for (size_t j = 0; j < m; j++)
+                memcpy(out + (done + j) * s->size + offset,
+                    scratch + j * fsize, fsize);
+
+            done += m;
+        }
+    }
+
+    r->pos += n;
+
+    return n;
+}
+
+// Read up to n values of field number field into values, packed
+// together with no gaps
+//
+// Returns the number read, which is 0 at the end of the file or if
+// there's no such field.
+
+size_t rec_read_column(struct rec_reader *r, int field, void *values, size_t n)
+{
+    const struct rec_schema *s = r->schema;
+
+    if (field < 0 || field >= s->nfields)
+        return 0;
+
+    size_t fsize = rec_type_size[s->fields[field].type];
+
+    if (n > r->count - r->pos)
+        n = r->count - r->pos;
+
+    if (r->layout == REC_SOA) {
+        if (fseek(r->fp, r->column_start[field] + r->pos * fsize,
+                SEEK_SET) != 0)
+            return 0;
+
+        n = fread(values, fsize, n, r->fp);
+
+        if (r->swap)
+            swap_values(values, fsize, n);
+
+        r->pos += n;
+
+        return n;
+    }
+
+    // REC_AOS: read whole records and keep the one field
+    unsigned char *out = values;
+    unsigned char *recs = malloc(REC_SCRATCH * s->size);
+    size_t offset = s->fields[field].offset;
+    size_t done = 0;
+
+    if (recs == NULL)
+        return 0;
+
+    while (done < n) {
+        size_t want = n - done < REC_SCRATCH? n - done: REC_SCRATCH;
+        size_t m = fread(recs, s->size, want, r->fp);
+
+        for (size_t j = 0; j < m; j++)
+            memcpy(out + (done + j) * fsize, recs + j * s->size + offset,
+                fsize);
+
+        done += m;
+
+        if (m < want)
+            break;
+    }
+
+    free(recs);
+
+    if (r->swap)
+        swap_values(values, fsize, done);
+
+    r->pos += done;
+
+    return done;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+#define CHUNK 65536  // Records or values per read
+
+struct sample {
+    int64_t id;
+    double x, y, z;
+    float weight;
+    int32_t flags;
+};
+
+const struct rec_field sample_fields[] = {
+    REC_FIELD(struct sample, id, REC_I64),
+    REC_FIELD(struct sample, x, REC_F64),
+    REC_FIELD(struct sample, y, REC_F64),
+    REC_FIELD(struct sample, z, REC_F64),
+    REC_FIELD(struct sample, weight, REC_F32),
+    REC_FIELD(struct sample, flags, REC_I32),
+};
+
+const struct rec_schema sample_schema = {
+    sizeof(struct sample),
+    sizeof sample_fields / sizeof *sample_fields,
+    sample_fields,
+};
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Add up the y column, one chunk at a time
+double sum_column(FILE *fp, double *seconds)
+{
+    struct rec_reader r;
+    double *y = malloc(CHUNK * sizeof *y);
+    double sum = 0;
+    size_t n;
+
+    double t0 = now();
+
+    rewind(fp);
+
+    if (y == NULL || rec_open(&r, fp, &sample_schema) == -1) {
+        printf("Couldn't open records\n");
+        exit(1);
+    }
+
+    while ((n = rec_read_column(&r, 2, y, CHUNK)) > 0)
+        for (size_t i = 0; i < n; i++)
+            sum += y[i];
+
+    *seconds = now() - t0;
+    free(y);
+
+    return sum;
+}
+
+// Read whole records, one chunk at a time, and add up the y fields
+double sum_records(FILE *fp, double *seconds)
+{
+    struct rec_reader r;
+    struct sample *s = malloc(CHUNK * sizeof *s);
+    double sum = 0;
+    size_t n;
+
+    double t0 = now();
+
+    rewind(fp);
+
+    if (s == NULL || rec_open(&r, fp, &sample_schema) == -1) {
+        printf("Couldn't open records\n");
+        exit(1);
+    }
+
+    while ((n = rec_read(&r, s, CHUNK)) > 0)
+        for (size_t i = 0; i < n; i++)
+            sum += s[i].y;
+
+    *seconds = now() - t0;
+    free(s);
+
+    return sum;
+}
+
+int main(int argc, char **argv)
+{
+    long count = argc > 1? atol(argv[1]): 10000000;
+
+    struct sample *s = malloc(count * sizeof *s);
+    FILE *aos = tmpfile(), *soa = tmpfile();
+
+    if (s == NULL || aos == NULL || soa == NULL) {
+        printf("Couldn't allocate records or temp files\n");
+        return 1;
+    }
+
+    double expect = 0;
+
+    for (long i = 0; i < count; i++) {
+        s[i] = (struct sample){
+            .id=i, .x=i * 0.5, .y=(i % 1000) * 0.25, .z=-i,
+            .weight=1.0f, .flags=i & 0xff,
+        };
+
+        expect += s[i].y;
+    }
+
+    double t0 = now();
+    rec_write(aos, &sample_schema, REC_AOS, s, count);
+    fflush(aos);
+    double t1 = now();
+    rec_write(soa, &sample_schema, REC_SOA, s, count);
+    fflush(soa);
+    double t2 = now();
+
+    free(s);
+
+    printf("%ld records of %zu bytes\n\n", count, sizeof(struct sample));
+    printf("write AoS:             %.3f s\n", t1 - t0);
+    printf("write SoA:             %.3f s\n\n", t2 - t1);
+
+    // Do one untimed pass over each file so both start out in the
+    // page cache
+    double secs, sum;
+
+    sum_records(aos, &secs);
+    sum_records(soa, &secs);
+
+    const struct {
+        char *name;
+        FILE *fp;
+        double (*f)(FILE *, double *);
+    } tests[] = {
+        {"column sum, AoS:", aos, sum_column},
+        {"column sum, SoA:", soa, sum_column},
+        {"record sum, AoS:", aos, sum_records},
+        {"record sum, SoA:", soa, sum_records},
+    };
+
+    for (size_t i = 0; i < sizeof tests / sizeof *tests; i++) {
+        sum = tests[i].f(tests[i].fp, &secs);
+
+        printf("%-22s %.3f s  %8.1f Mrecords/s%s\n", tests[i].name, secs,
+            count / secs / 1e6, sum == expect? "": "  MISMATCH");
+    }
+
+    fclose(aos);
+    fclose(soa);
+}
@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Faster binary searching on sorted int tables
+//
+// bsearch() calls a comparison function through a pointer for every
+// probe, and it branches on the result. On big tables, it also misses
+// the cache on almost every probe, because each one jumps halfway
+// across what's left.
+//
+// Here are two fixes:
+//
+// lower_bound() is a plain binary search on a sorted array, but written
+// so that the compiler can use a conditional move instead of a branch.
+//
+// The eytz_*() functions rearrange the sorted array into "Eytzinger"
+// order, which is the order you'd visit the nodes of a balanced binary
+// search tree breadth-first. The root is at index 1, and the children
+// of node k are at 2k and 2k+1. That puts the first several levels of
+// the search next to each other in memory, and it means we know where
+// the search is going a few levels ahead--so we can prefetch it.
+
+// __builtin_prefetch() is a GCC/Clang extension. Elsewhere, skip it.
+#ifdef __GNUC__
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p) ((void)(p))
+#endif
+
+// Return the index of the first element in sorted array a that is not
+// less than key, or n if there isn't one.
+
+size_t lower_bound(const int *a, size_t n, int key)
+{
+    const int *base = a;
+
+    if (n == 0)
+        return 0;
+
+    while (n > 1) {
+        size_t half = n / 2;
+
+        // No branch here: this turns into a conditional move
+        base = base[half - 1] < key? base + half: base;
+        n -= half;
+    }
+
+    return (base - a) + (*base < key);
+}
+
+// Look up a bunch of keys at once, storing the results in out
+void lower_bound_batch(const int *a, size_t n, const int *keys,
+                       size_t nkeys, size_t *out)
+{
+    for (size_t i = 0; i < nkeys; i++)
+        out[i] = lower_bound(a, n, keys[i]);
+}
+
+// A table in Eytzinger order
+struct eytz {
+    int *b;    // The table, starting at index 1
+    size_t n;  // How many elements are in it
+};
+
+// Fill b with a in Eytzinger order. i is the next element of a to
+// place, and k is the node we're filling.
+static size_t eytz_fill(const int *a, int *b, size_t i, size_t k, size_t n)
+{
+    if (k <= n) {
+        i = eytz_fill(a, b, i, 2 * k, n);      // Everything on the left
+        b[k] = a[i++];                         // This node
+        i = eytz_fill(a, b, i, 2 * k + 1, n);  // Everything on the right
+    }
+
+    return i;
+}
+
+// Build an Eytzinger table from a sorted array
+//
+// Returns 0 on success, -1 if out of memory.
+
+int eytz_build(struct eytz *e, const int *a, size_t n)
+{
+    // Line the table up on a cache line so that each prefetch pulls in
+    // one whole group of 16 descendants. aligned_alloc() wants the size
+    // to be a multiple of the alignment, so round up.
+    size_t bytes = ((n + 1) * sizeof(int) + 63) / 64 * 64;
+
+    e->b = aligned_alloc(64, bytes);
+    e->n = n;
+
+    if (e->b == NULL)
+        return -1;
+
+    eytz_fill(a, e->b, 0, 1, n);
+
+    return 0;
+}
+
+void eytz_free(struct eytz *e)
+{
+    free(e->b);
+    e->b = NULL;
+}
+
+// Undo the extra steps that a search takes past the answer
+//
+// When the search falls off the bottom of the tree, the low bits of k
+// record which way it went at each level: 1 for right, 0 for left. The
+// answer is the last node where we went left, so we drop all the
+// trailing 1s and then that 0.
+static inline size_t eytz_unwind(size_t k)
+{
+    while (k & 1)
+        k >>= 1;
+
+    return k >> 1;
+}
+
+// Return the index in e->b of the first element not less than key, or
+// 0 if there isn't one.
+
+size_t eytz_search(const struct eytz *e, int key)
+{
+    size_t k = 1;
+
+    while (k <= e->n) {
+        // Four levels down, 16 ints, one cache line
+        PREFETCH(e->b + k * 16);
+
+        k = 2 * k + (e->b[k] < key);
+    }
+
+    return eytz_unwind(k);
+}
+
+// Look up a bunch of keys at once, storing the results in out
+//
+// This runs several searches in lockstep, so the cache misses for all
+// of them can be in flight at the same time.
+
+#define EYTZ_BATCH 8
+
+void eytz_search_batch(const struct eytz *e, const int *keys, size_t nkeys,
+                       size_t *out)
+{
+    // How many levels every search is sure to go down
+    int levels = 0;
+
+    for (size_t n = e->n; n > 0; n >>= 1)
+        levels++;
+
+    levels--;  // The last level might not be full
+
+    size_t i = 0;
+
+    for (; i + EYTZ_BATCH <= nkeys; i += EYTZ_BATCH) {
+        size_t k[EYTZ_BATCH];
+
+        for (int j = 0; j < EYTZ_BATCH; j++)
+            k[j] = 1;
+
+        for (int level = 0; level < levels; level++)
+            for (int j = 0; j < EYTZ_BATCH; j++) {
+                PREFETCH(e->b + k[j] * 16);
+                k[j] = 2 * k[j] + (e->b[k[j]] < keys[i + j]);
+            }
+
+        // Finish off the last, partial level one at a time
+        for (int j = 0; j < EYTZ_BATCH; j++) {
+            if (k[j] <= e->n)
+                k[j] = 2 * k[j] + (e->b[k[j]] < keys[i + j]);
+
+            out[i + j] = eytz_unwind(k[j]);
+        }
+    }
+
+    for (; i < nkeys; i++)
+        out[i] = eytz_search(e, keys[i]);
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+int compar(const void *elem0, const void *elem1)
+{
+    const int *x = elem0, *y = elem1;
+
+    if (*x > *y) return 1;
+    if (*x < *y) return -1;
+    return 0;
+}
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#define LOOKUPS 4000000
+
+int main(int argc, char **argv)
+{
+    // Biggest table to try, in elements
+    size_t max_n = argc > 1? strtoul(argv[1], NULL, 10): 64 * 1024 * 1024;
+
+    int *keys = malloc(LOOKUPS * sizeof *keys);
+    size_t *out = malloc(LOOKUPS * sizeof *out);
+    size_t *expect = malloc(LOOKUPS * sizeof *expect);
+
+    if (keys == NULL || out == NULL || expect == NULL) {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    printf("%10s %10s %10s %10s %10s %10s  (million lookups/s)\n",
+        "elements", "bytes", "bsearch", "lower_bnd", "eytz", "eytz_batch");
+
+    // Go from a table that fits in L1 to one that only fits in DRAM
+    for (size_t n = 1024; n <= max_n; n *= 4) {
+        int *a = malloc(n * sizeof *a);
+        struct eytz e;
+
+        if (a == NULL) {
+            printf("Out of memory\n");
+            return 1;
+        }
+
+        // Even numbers, so half the lookups miss
+        for (size_t i = 0; i < n; i++)
+            a[i] = i * 2;
+
+        if (eytz_build(&e, a, n) == -1) {
+            printf("Out of memory\n");
+            return 1;
+        }
+
+        srand(1);
+
+        for (size_t i = 0; i < LOOKUPS; i++)
+            keys[i] = ((size_t)rand() * RAND_MAX + rand()) % (n * 2);
+
+        double t0, t1;
+        size_t found = 0;
+
+        t0 = now();
+        for (size_t i = 0; i < LOOKUPS; i++)
+            found += bsearch(keys + i, a, n, sizeof *a, compar) != NULL;
+        t1 = now();
+        double bs_rate = LOOKUPS / (t1 - t0) / 1e6;
+
+        t0 = now();
+        lower_bound_batch(a, n, keys, LOOKUPS, expect);
+        t1 = now();
+        double lb_rate = LOOKUPS / (t1 - t0) / 1e6;
+
+        t0 = now();
+        for (size_t i = 0; i < LOOKUPS; i++)
+            out[i] = eytz_search(&e, keys[i]);
+        t1 = now();
+        double ey_rate = LOOKUPS / (t1 - t0) / 1e6;
+
+        // Make sure Eytzinger found the same elements as lower_bound()
+        int match = 1;
+
+        for (size_t i = 0; i < LOOKUPS; i++) {
+            int want = expect[i] == n? -1: a[expect[i]];
+            int got = out[i] == 0? -1: e.b[out[i]];
+
+            if (want != got)
+                match = 0;
+        }
+
+        t0 = now();
+        eytz_search_batch(&e, keys, LOOKUPS, out);
+        t1 = now();
+        double eb_rate = LOOKUPS / (t1 - t0) / 1e6;
+
+        for (size_t i = 0; i < LOOKUPS; i++) {
+            int want = expect[i] == n? -1: a[expect[i]];
+            int got = out[i] == 0? -1: e.b[out[i]];
+
+            if (want != got)
+                match = 0;
+        }
+
+        printf("%10zu %10zu %10.1f %10.1f %10.1f %10.1f  %s\n",
+            n, n * sizeof *a, bs_rate, lb_rate, ey_rate, eb_rate,
+            match? "match": "MISMATCH");
+
+        // Use found so the bsearch() loop can't be optimized away
+        if (found > LOOKUPS)
+            printf("???\n");
+
+        eytz_free(&e);
+        free(a);
+    }
+
+    free(expect);
+    free(out);
+    free(keys);
+}
@@ -0,0 +1,588 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+
+// Scanning strings more than a byte at a time
+//
+// my_strlen() in pointers2_mystrlen.c looks at one character per trip
+// through the loop. Here are strlen(), strchr(), strrchr(), and memchr()
+// work-alikes that look at many at once:
+//
+// SWAR ("SIMD within a register") versions load 8 bytes into a
+// uint64_t and use some bit tricks to find out if any of them is zero,
+// or is the character we want.
+//
+// On x86, SSE2 versions look at 16 bytes at once and AVX2 versions at
+// 32, using the compiler's vector intrinsics. The best one the CPU has
+// gets picked the first time you call one of the scan_*() functions.
+//
+// They give exactly the same answers as the library functions. But
+// there's a catch: strlen() can't know how long the string is until
+// it finds the end, so loading 8 or 32 bytes at once might read past
+// the NUL, off the end of the array. We get away with it by only ever
+// loading from addresses that are a multiple of the load size. A page
+// of memory is always a multiple of that, too, so if any byte of an
+// aligned load is in a good page, they all are. We never read a byte
+// in a page the string doesn't touch, so we can't crash.
+//
+// That's not something the C spec promises--reading past the end of an
+// array is undefined behavior. But every real libc's strlen() does
+// exactly this, and so do we. (memchr() knows how many bytes it has,
+// so the SWAR version never reads past them at all.)
+
+#define ONES  0x0101010101010101ULL
+#define LOWS  0x7f7f7f7f7f7f7f7fULL
+
+// ---------------------------------------------------------------------
+// One byte at a time, for comparison
+
+size_t strlen_byte(const char *s)
+{
+    const char *p = s;
+
+    while (*p != '\0')
+        p++;
+
+    return p - s;
+}
+
+char *strchr_byte(const char *s, int c)
+{
+    for (;; s++) {
+        if (*s == (char)c)
+            return (char *)s;
+
+        if (*s == '\0')
+            return NULL;
+    }
+}
+
+char *strrchr_byte(const char *s, int c)
+{
+    const char *last = NULL;
+
+    for (;; s++) {
+        if (*s == (char)c)
+            last = s;
+
+        if (*s == '\0')
+            return (char *)last;
+    }
+}
+
+void *memchr_byte(const void *s, int c, size_t n)
+{
+    const unsigned char *p = s;
+
+    for (; n > 0; p++, n--)
+        if (*p == (unsigned char)c)
+            return (void *)p;
+
+    return NULL;
+}
+
+// ---------------------------------------------------------------------
+// SWAR
+
+// Returns a word with the high bit set in each byte of v that's zero,
+// and every other bit clear
+static uint64_t zero_bytes(uint64_t v)
+{
+    return ~(((v & LOWS) + LOWS) | v | LOWS);
+}
+
+// Index of the first byte (in memory order) flagged by zero_bytes()
+static int first_byte(uint64_t mask)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_clzll(mask) / 8;
+#else
+    return __builtin_ctzll(mask) / 8;
+#endif
+}
+
+// And the last one
+static int last_byte(uint64_t mask)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_ctzll(mask) / 8;
+#else
+    return (63 - __builtin_clzll(mask)) / 8;
+#endif
+}
+
+static uint64_t load_word(const void *p)
+{
+    uint64_t w;
+
+    memcpy(&w, p, sizeof w);  // p is aligned, so this is one load
+
+    return w;
+}
+
+size_t strlen_swar(const char *s)
+{
+    const char *p = s;
+
+    // A byte at a time until we're aligned
+    for (; (uintptr_t)p % 8 != 0; p++)
+        if (*p == '\0')
+            return p - s;
+
+    for (;; p += 8) {
+        uint64_t z = zero_bytes(load_word(p));
+
+        if (z != 0)
+            return p - s + first_byte(z);
+    }
+}
+
+char *strchr_swar(const char *s, int c)
+{
+    const char *p = s;
+
+    for (; (uintptr_t)p % 8 != 0; p++) {
+        if (*p == (char)c)
+            return (char *)p;
+
+        if (*p == '\0')
+            return NULL;
+    }
+
+    uint64_t cc = (unsigned char)c * ONES;
+
+    for (;; p += 8) {
+        uint64_t w = load_word(p);
+        uint64_t z = zero_bytes(w) | zero_bytes(w ^ cc);
+
+        if (z != 0) {
+            p += first_byte(z);
+            return *p == (char)c? (char *)p: NULL;
+        }
+    }
+}
+
+char *strrchr_swar(const char *s, int c)
+{
+    // Looking for the NUL is just strlen()
+    if ((char)c == '\0')
+        return (char *)s + strlen_swar(s);
+
+    const char *p = s, *last = NULL;
+
+    for (; (uintptr_t)p % 8 != 0; p++) {
+        if (*p == (char)c)
+            last = p;
+
+        if (*p == '\0')
+            return (char *)last;
+    }
+
+    uint64_t cc = (unsigned char)c * ONES;
+
+    for (;; p += 8) {
+        uint64_t w = load_word(p);
+
+        if (zero_bytes(w) != 0)
+            break;
+
+        uint64_t z = zero_bytes(w ^ cc);
+
+        if (z != 0)
+            last = p + last_byte(z);
+    }
+
+    // The word with the NUL in it, a byte at a time so we don't count
+    // anything after the end
+    for (; *p != '\0'; p++)
+        if (*p == (char)c)
+            last = p;
+
+    return (char *)last;
+}
+
+void *memchr_swar(const void *s, int c, size_t n)
+{
+    const unsigned char *p = s;
+
+    for (; n > 0 && (uintptr_t)p % 8 != 0; p++, n--)
+        if (*p == (unsigned char)c)
+            return (void *)p;
+
+    uint64_t cc = (unsigned char)c * ONES;
+
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t z = zero_bytes(load_word(p) ^ cc);
+
+        if (z != 0)
+            return (void *)(p + first_byte(z));
+    }
+
+    for (; n > 0; p++, n--)
+        if (*p == (unsigned char)c)
+            return (void *)p;
+
+    return NULL;
+}
+
+// ---------------------------------------------------------------------
+// SSE2 and AVX2
+//
+// The target attributes let us use these instructions in just these
+// functions, without building the whole program for a CPU that has
+// them. We only call them after checking that this one does.
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SCAN_X86 1
+#include <immintrin.h>
+
+// Each vector version starts with an aligned load at or before s, and
+// shifts off the mask bits for the bytes before s.
+
+#define SCAN_VECTOR_FUNCS(ISA, VEC, WIDTH, LOAD, SET1, CMPEQ, OR, MOVEMASK) \
+\
+__attribute__((target(#ISA))) \
+size_t strlen_ ## ISA(const char *s) \
+{ \
+    uintptr_t off = (uintptr_t)s % WIDTH; \
+    const char *p = s - off; \
+    VEC zero = SET1(0); \
+    uint32_t m = (uint32_t)MOVEMASK(CMPEQ(LOAD((const VEC *)p), zero)) >> off; \
+\
+    if (m != 0) \
+        return __builtin_ctz(m); \
+\
+    for (;;) { \
+        p += WIDTH; \
+        m = MOVEMASK(CMPEQ(LOAD((const VEC *)p), zero)); \
+\
+        if (m != 0) \
+            return p - s + __builtin_ctz(m); \
+    } \
+} \
+\
+__attribute__((target(#ISA))) \
+char *strchr_ ## ISA(const char *s, int c) \
+{ \
+    uintptr_t off = (uintptr_t)s % WIDTH; \
+    const char *p = s - off; \
+    VEC zero = SET1(0), cv = SET1((char)c); \
+    VEC v = LOAD((const VEC *)p); \
+    uint32_t m = (uint32_t)MOVEMASK(OR(CMPEQ(v, zero), CMPEQ(v, cv))) >> off; \
+\
+    if (m == 0) { \
+        do { \
+            p += WIDTH; \
+            v = LOAD((const VEC *)p); \
+            m = MOVEMASK(OR(CMPEQ(v, zero), CMPEQ(v, cv))); \
+        } while (m == 0); \
+    } else \
+        p = s; \
+\
+    p += __builtin_ctz(m); \
+\
+    return *p == (char)c? (char *)p: NULL; \
+} \
+\
+/* For strrchr(), only count matches up to and including the first NUL */ \
+__attribute__((target(#ISA))) \
+char *strrchr_ ## ISA(const char *s, int c) \
+{ \
+    if ((char)c == '\0') \
+        return (char *)s + strlen_ ## ISA(s); \
+\
+    uintptr_t off = (uintptr_t)s % WIDTH; \
+    const char *p = s - off, *base = s, *last = NULL; \
+    VEC zero = SET1(0), cv = SET1((char)c); \
+    VEC v = LOAD((const VEC *)p); \
+    uint32_t z = (uint32_t)MOVEMASK(CMPEQ(v, zero)) >> off; \
+    uint32_t m = (uint32_t)MOVEMASK(CMPEQ(v, cv)) >> off; \
+\
+    /* Bit 0 of z and m is the byte at base */ \
+    for (;;) { \
+        if (z != 0) \
+            m &= z ^ (z - 1); \
+\
+        if (m != 0) \
+            last = base + 31 - __builtin_clz(m); \
+\
+        if (z != 0) \
+            return (char *)last; \
+\
+        p += WIDTH; \
+        base = p; \
+        v = LOAD((const VEC *)p); \
+        z = MOVEMASK(CMPEQ(v, zero)); \
+        m = MOVEMASK(CMPEQ(v, cv)); \
+    } \
+} \
+\
+__attribute__((target(#ISA))) \
+void *memchr_ ## ISA(const void *s, int c, size_t n) \
+{ \
+    if (n == 0) \
+        return NULL; \
+\
+    uintptr_t off = (uintptr_t)s % WIDTH; \
+    const char *p = (const char *)s - off; \
+    VEC cv = SET1((char)c); \
+    uint32_t m = (uint32_t)MOVEMASK(CMPEQ(LOAD((const VEC *)p), cv)) >> off; \
+    size_t i = 0; \
+\
+    /* i is how far past s the current block starts */ \
+    while (m == 0) { \
+        i += WIDTH - (i == 0? off: 0); \
+\
+        if (i >= n) \
+            return NULL; \
+\
+        p += WIDTH; \
+        m = MOVEMASK(CMPEQ(LOAD((const VEC *)p), cv)); \
+    } \
+\
+    i += __builtin_ctz(m); \
+\
+    return i < n? (char *)s + i: NULL; \
+}
+
+SCAN_VECTOR_FUNCS(sse2, __m128i, 16, _mm_load_si128, _mm_set1_epi8,
+    _mm_cmpeq_epi8, _mm_or_si128, _mm_movemask_epi8)
+
+SCAN_VECTOR_FUNCS(avx2, __m256i, 32, _mm256_load_si256, _mm256_set1_epi8,
+    _mm256_cmpeq_epi8, _mm256_or_si256, _mm256_movemask_epi8)
+
+#else
+#define SCAN_X86 0
+#endif
+
+// ---------------------------------------------------------------------
+// Picking one at runtime
+
+struct scanner {
+    char *name;
+    size_t (*len)(const char *);                // strlen()
+    char *(*chr)(const char *, int);            // strchr()
+    char *(*rchr)(const char *, int);           // strrchr()
+    void *(*mem)(const void *, int, size_t);    // memchr()
+};
+
+const struct scanner scanners[] = {
+    {"byte", strlen_byte, strchr_byte, strrchr_byte, memchr_byte},
+    {"swar", strlen_swar, strchr_swar, strrchr_swar, memchr_swar},
+#if SCAN_X86
+    {"sse2", strlen_sse2, strchr_sse2, strrchr_sse2, memchr_sse2},
+    {"avx2", strlen_avx2, strchr_avx2, strrchr_avx2, memchr_avx2},
+#endif
+};
+
+#define SCANNER_COUNT (sizeof scanners / sizeof *scanners)
+
+// Can this CPU run scanners[i]?
+int scanner_supported(size_t i)
+{
+#if SCAN_X86
+    __builtin_cpu_init();
+
+    if (strcmp(scanners[i].name, "sse2") == 0)
+        return __builtin_cpu_supports("sse2");
+
+    if (strcmp(scanners[i].name, "avx2") == 0)
+        return __builtin_cpu_supports("avx2");
+#endif
+    (void)i;
+
+    return 1;
+}
+
+// The one we're using, or NULL if we haven't picked yet. It's atomic
+// since two threads might make their first call at the same time. They'd
+// both pick the same one, but it's still a race without this.
+static _Atomic(const struct scanner *) scanner;
+
+static const struct scanner *get_scanner(void)
+{
+    const struct scanner *s = atomic_load_explicit(&scanner,
+        memory_order_acquire);
+
+    if (s == NULL) {
+        // The last one that works is the fastest
+        for (size_t i = 0; i < SCANNER_COUNT; i++)
+            if (scanner_supported(i))
+                s = &scanners[i];
+
+        atomic_store_explicit(&scanner, s, memory_order_release);
+    }
+
+    return s;
+}
+
+size_t scan_strlen(const char *s)
+{
+    return get_scanner()->len(s);
+}
+
+char *scan_strchr(const char *s, int c)
+{
+    return get_scanner()->chr(s, c);
+}
+
+char *scan_strrchr(const char *s, int c)
+{
+    return get_scanner()->rchr(s, c);
+}
+
+void *scan_memchr(const void *s, int c, size_t n)
+{
+    return get_scanner()->mem(s, c, n);
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+#define ALIGN 64
+#define MAX_LEN (1024 * 1024)
+
+const size_t lens[] = {8, 64, 512, 4096, 32768, 262144, MAX_LEN};
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Wrappers so libc looks like the others
+size_t strlen_libc(const char *s) { return strlen(s); }
+char *strchr_libc(const char *s, int c) { return strchr(s, c); }
+char *strrchr_libc(const char *s, int c) { return strrchr(s, c); }
+void *memchr_libc(const void *s, int c, size_t n) { return memchr(s, c, n); }
+
+const struct scanner libc = {
+    "libc", strlen_libc, strchr_libc, strrchr_libc, memchr_libc
+};
+
+// Check every scanner against libc, for lots of lengths and alignments
+int check(char *buf)
+{
+    int errors = 0;
+
+    for (size_t i = 0; i < SCANNER_COUNT; i++) {
+        const struct scanner *s = &scanners[i];
+
+        if (!scanner_supported(i))
+            continue;
+
+        for (size_t off = 0; off < ALIGN; off++)
+            for (size_t len = 0; len < 300; len++) {
+                char *str = buf + off;
+
+                memset(buf, 'a', ALIGN + 400);
+                str[len] = '\0';
+
+                // Some 'x's, and one past the end that mustn't be found
+                if (len > 0)
+                    str[len / 2] = 'x';
+
+                if (len > 3)
+                    str[len / 3] = 'x';
+
+                str[len + 1] = 'x';
+
+                for (int c = 0; c < 3; c++) {
+                    int ch = "xz\0"[c];
+
+                    errors += s->len(str) != strlen(str);
+                    errors += s->chr(str, ch) != strchr(str, ch);
+                    errors += s->rchr(str, ch) != strrchr(str, ch);
+                    errors += s->mem(str, ch, len) != memchr(str, ch, len);
+                    errors += s->mem(str, ch, len / 3) !=
+                        memchr(str, ch, len / 3);
+                }
+            }
+    }
+
+    return errors;
+}
+
+int main(int argc, char **argv)
+{
+    // How many bytes to scan in total for each measurement
+    double total = argc > 1? atof(argv[1]): 256e6;
+
+    char *buf = aligned_alloc(ALIGN, MAX_LEN + ALIGN);
+
+    if (buf == NULL) {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    if (check(buf) != 0) {
+        printf("MISMATCH against libc!\n");
+        return 1;
+    }
+
+    printf("Using %s\n\n", get_scanner()->name);
+
+    const struct scanner *all[SCANNER_COUNT + 1];
+    size_t count = 0;
+
+    all[count++] = &libc;
+
+    for (size_t i = 0; i < SCANNER_COUNT; i++)
+        if (scanner_supported(i))
+            all[count++] = &scanners[i];
+
+    // A string of 'a's with an 'x' at the very end
+    char *str = buf + 3;  // Not aligned, to be fair
+    volatile size_t sink = 0;
+
+    for (int f = 0; f < 4; f++) {
+        printf("%-8s", (char *[]){"strlen", "strchr", "strrchr", "memchr"}[f]);
+
+        for (size_t i = 0; i < count; i++)
+            printf(" %9s", all[i]->name);
+
+        printf("   (GB/s)\n");
+
+        for (size_t k = 0; k < sizeof lens / sizeof *lens; k++) {
+            size_t len = lens[k];
+
+            memset(str, 'a', len);
+            str[len - 1] = 'x';
+            str[len] = '\0';
+
+            long iters = total / len;
+
+            printf("%7zu:", len);
+
+            for (size_t i = 0; i < count; i++) {
+                const struct scanner *s = all[i];
+
+                double t0 = now();
+
+                for (long j = 0; j < iters; j++)
+                    switch (f) {
+                        case 0: sink += s->len(str); break;
+                        case 1: sink += s->chr(str, 'x') - str; break;
+                        case 2: sink += s->rchr(str, 'x') - str; break;
+                        case 3: sink += (char *)s->mem(str, 'x', len) - str;
+                    }
+
+                double t1 = now();
+
+                printf(" %9.2f", iters * (double)len / (t1 - t0) / 1e9);
+            }
+
+            printf("\n");
+        }
+
+        printf("\n");
+    }
+
+    free(buf);
+}
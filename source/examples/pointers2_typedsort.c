@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pointers2_typedsort.h"
+
+// The type of structure we're going to sort
+struct animal {
+    char *name;
+    int leg_count;
+};
+
+// "Less than" tests for the typed sorts. These get inlined right into
+// the generated sort functions.
+#define int_less(a, b) (*(a) < *(b))
+#define double_less(a, b) (*(a) < *(b))
+
+static inline int animal_less(const struct animal *a1,
+                              const struct animal *a2)
+{
+    return a1->leg_count < a2->leg_count;
+}
+
+// Stamp out sort_int(), sort_double(), and sort_animal()
+TYPEDSORT(sort_int, int, int_less)
+TYPEDSORT(sort_double, double, double_less)
+TYPEDSORT(sort_animal, struct animal, animal_less)
+
+// The usual qsort() comparison functions, for the benchmark
+int compar_int(const void *elem0, const void *elem1)
+{
+    const int *x = elem0, *y = elem1;
+
+    return (*x > *y) - (*x < *y);
+}
+
+int compar_double(const void *elem0, const void *elem1)
+{
+    const double *x = elem0, *y = elem1;
+
+    return (*x > *y) - (*x < *y);
+}
+
+int compar_animal(const void *elem0, const void *elem1)
+{
+    const struct animal *a1 = elem0, *a2 = elem1;
+
+    return (a1->leg_count > a2->leg_count) - (a1->leg_count < a2->leg_count);
+}
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = argc > 1? strtoul(argv[1], NULL, 10): 10000000;
+
+    // Two copies of each array: one for qsort(), one for the typed sort
+    int *i0 = malloc(n * sizeof *i0), *i1 = malloc(n * sizeof *i1);
+    double *d0 = malloc(n * sizeof *d0), *d1 = malloc(n * sizeof *d1);
+    struct animal *a0 = malloc(n * sizeof *a0), *a1 = malloc(n * sizeof *a1);
+
+    if (!i0 || !i1 || !d0 || !d1 || !a0 || !a1) {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    char *names[] = {"Dog", "Monkey", "Antelope", "Snake", "Spider"};
+
+    srand(1);
+
+    for (size_t i = 0; i < n; i++) {
+        i0[i] = i1[i] = rand() - RAND_MAX / 2;
+        d0[i] = d1[i] = (double)rand() / RAND_MAX;
+
+        a0[i].name = a1[i].name = names[rand() % 5];
+        a0[i].leg_count = a1[i].leg_count = rand() % 1000;
+    }
+
+    double t0, t1, t2;
+
+    printf("Sorting %zu elements\n", n);
+
+    t0 = now();
+    qsort(i0, n, sizeof *i0, compar_int);
+    t1 = now();
+    sort_int(i1, n);
+    t2 = now();
+
+    printf("int:           qsort %.2f s, sort_int %.2f s, %s\n",
+        t1 - t0, t2 - t1,
+        memcmp(i0, i1, n * sizeof *i0) == 0? "match": "MISMATCH");
+
+    t0 = now();
+    qsort(d0, n, sizeof *d0, compar_double);
+    t1 = now();
+    sort_double(d1, n);
+    t2 = now();
+
+    printf("double:        qsort %.2f s, sort_double %.2f s, %s\n",
+        t1 - t0, t2 - t1,
+        memcmp(d0, d1, n * sizeof *d0) == 0? "match": "MISMATCH");
+
+    t0 = now();
+    qsort(a0, n, sizeof *a0, compar_animal);
+    t1 = now();
+    sort_animal(a1, n);
+    t2 = now();
+
+    // Neither sort is stable, so only the keys have to match
+    int match = 1;
+
+    for (size_t i = 0; i < n; i++)
+        if (a0[i].leg_count != a1[i].leg_count)
+            match = 0;
+
+    printf("struct animal: qsort %.2f s, sort_animal %.2f s, %s\n",
+        t1 - t0, t2 - t1, match? "match": "MISMATCH");
+
+    free(i0); free(i1);
+    free(d0); free(d1);
+    free(a0); free(a1);
+}
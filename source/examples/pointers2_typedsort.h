@@ -0,0 +1,124 @@
+#ifndef POINTERS2_TYPEDSORT_H
+#define POINTERS2_TYPEDSORT_H
+
+#include <stddef.h>
+
+// Generate a sort function for a specific type
+//
+// qsort() has to call its comparison function through a pointer for
+// every comparison, and it can't inline it. This macro stamps out a
+// whole sort routine for one type instead, so the compiler sees the
+// comparison directly and can inline it.
+//
+// NAME is the name of the sort function to build.
+// T is the element type.
+// LESS(a, b) is a function or macro that takes two T pointers and is
+// true if *a should come before *b.
+//
+// For example:
+//
+//     #define int_less(a, b) (*(a) < *(b))
+//     TYPEDSORT(sort_int, int, int_less)
+//
+// gives you:
+//
+//     void sort_int(int *base, size_t nmemb);
+//
+// The sort is an introsort: quicksort with a median-of-three pivot,
+// falling back to heapsort if the recursion gets too deep, and
+// finishing small ranges with insertion sort. Like qsort(), it's not
+// stable.
+
+#define TYPEDSORT_SMALL 16  // Use insertion sort at or below this size
+
+#define TYPEDSORT(NAME, T, LESS) \
+\
+static inline void NAME ## _swap(T *a, T *b) \
+{ \
+    T t = *a; *a = *b; *b = t; \
+} \
+\
+static inline void NAME ## _insertion(T *a, size_t n) \
+{ \
+    for (size_t i = 1; i < n; i++) { \
+        T v = a[i]; \
+        size_t j = i; \
+        for (; j > 0 && LESS(&v, &a[j - 1]); j--) \
+            a[j] = a[j - 1]; \
+        a[j] = v; \
+    } \
+} \
+\
+static inline void NAME ## _siftdown(T *a, size_t i, size_t n) \
+{ \
+    for (;;) { \
+        size_t child = 2 * i + 1; \
+        if (child >= n) break; \
+        if (child + 1 < n && LESS(&a[child], &a[child + 1])) child++; \
+        if (!LESS(&a[i], &a[child])) break; \
+        NAME ## _swap(&a[i], &a[child]); \
+        i = child; \
+    } \
+} \
+\
+static void NAME ## _heapsort(T *a, size_t n) \
+{ \
+    if (n < 2) return; \
+    for (size_t i = n / 2; i > 0; i--) \
+        NAME ## _siftdown(a, i - 1, n); \
+    for (size_t i = n - 1; i > 0; i--) { \
+        NAME ## _swap(&a[0], &a[i]); \
+        NAME ## _siftdown(a, 0, i); \
+    } \
+} \
+\
+static void NAME ## _introsort(T *a, size_t n, int depth) \
+{ \
+    while (n > TYPEDSORT_SMALL) { \
+        if (depth-- == 0) { \
+            NAME ## _heapsort(a, n); \
+            return; \
+        } \
+\
+        /* Median of three, leaving the pivot in a[0] */ \
+        size_t mid = n / 2; \
+        if (LESS(&a[mid], &a[0])) NAME ## _swap(&a[mid], &a[0]); \
+        if (LESS(&a[n - 1], &a[mid])) { \
+            NAME ## _swap(&a[n - 1], &a[mid]); \
+            if (LESS(&a[mid], &a[0])) NAME ## _swap(&a[mid], &a[0]); \
+        } \
+        NAME ## _swap(&a[0], &a[mid]); \
+\
+        /* Hoare partition around a[0] */ \
+        size_t i = 0, j = n; \
+        for (;;) { \
+            do i++; while (LESS(&a[i], &a[0])); \
+            do j--; while (LESS(&a[0], &a[j])); \
+            if (i >= j) break; \
+            NAME ## _swap(&a[i], &a[j]); \
+        } \
+        NAME ## _swap(&a[0], &a[j]); \
+\
+        /* Recurse on the smaller side, loop on the bigger one */ \
+        if (j < n - j - 1) { \
+            NAME ## _introsort(a, j, depth); \
+            a += j + 1; \
+            n -= j + 1; \
+        } else { \
+            NAME ## _introsort(a + j + 1, n - j - 1, depth); \
+            n = j; \
+        } \
+    } \
+\
+    NAME ## _insertion(a, n); \
+} \
+\
+static inline void NAME(T *base, size_t nmemb) \
+{ \
+    int depth = 0; \
+    for (size_t n = nmemb; n > 1; n >>= 1) \
+        depth += 2; \
+    NAME ## _introsort(base, nmemb, depth); \
+}
+
+#endif
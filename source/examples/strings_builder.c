@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+// A string builder
+//
+// Every strcat(dest, src) has to find the end of dest first, by walking
+// all the way down it looking for the NUL. Build a long string out of
+// lots of little pieces that way, and you walk over the start of it
+// again and again. Twice as many pieces takes four times as long.
+//
+// A struct strbuf remembers how long its string is, so appending goes
+// straight to the end. It also remembers how much room it has, and when
+// it runs out, it doubles it, so there are only a handful of realloc()s
+// no matter how big it gets.
+//
+// Short strings don't need malloc() at all: they live in a little
+// buffer right inside the struct until they outgrow it.
+//
+// The string is always NUL-terminated, so sb_str() can go right to
+// printf() or any other string function.
+
+#define SB_INLINE 32  // Bytes of string (with the NUL) kept in the struct
+
+struct strbuf {
+    size_t len;  // Not counting the NUL
+    size_t cap;  // Room for this many bytes, including the NUL
+    union {
+        char *heap;              // When cap > SB_INLINE
+        char small[SB_INLINE];   // Otherwise
+    };
+};
+
+// Start out empty
+void sb_init(struct strbuf *sb)
+{
+    sb->len = 0;
+    sb->cap = SB_INLINE;
+    sb->small[0] = '\0';
+}
+
+// The string so far
+char *sb_str(struct strbuf *sb)
+{
+    return sb->cap > SB_INLINE? sb->heap: sb->small;
+}
+
+size_t sb_len(const struct strbuf *sb)
+{
+    return sb->len;
+}
+
+// Make sure there's room for extra more bytes plus the NUL
+//
+// Returns 0 on success, -1 if we're out of memory.
+
+int sb_reserve(struct strbuf *sb, size_t extra)
+{
+    size_t need = sb->len + extra + 1;
+
+    if (need <= sb->cap)
+        return 0;
+
+    size_t cap = sb->cap * 2;
+
+    if (cap < need)
+        cap = need;
+
+    char *p;
+
+    if (sb->cap > SB_INLINE) {
+        if ((p = realloc(sb->heap, cap)) == NULL)
+            return -1;
+
+    } else {
+        // Moving out of the inline buffer
+        if ((p = malloc(cap)) == NULL)
+            return -1;
+
+        memcpy(p, sb->small, sb->len + 1);
+    }
+
+    sb->heap = p;
+    sb->cap = cap;
+
+    return 0;
+}
+
+// Append n bytes from s
+//
+// Returns 0 on success, -1 if we're out of memory.
+
+int sb_append_len(struct strbuf *sb, const char *s, size_t n)
+{
+    if (sb_reserve(sb, n) == -1)
+        return -1;
+
+    char *p = sb_str(sb);
+
+    memcpy(p + sb->len, s, n);
+    sb->len += n;
+    p[sb->len] = '\0';
+
+    return 0;
+}
+
+// Append the string s
+int sb_append(struct strbuf *sb, const char *s)
+{
+    return sb_append_len(sb, s, strlen(s));
+}
+
+// Append a single character
+int sb_append_char(struct strbuf *sb, char c)
+{
+    return sb_append_len(sb, &c, 1);
+}
+
+// Append printf()-style
+//
+// Returns 0 on success, -1 on failure.
+
+int sb_append_fmt(struct strbuf *sb, const char *format, ...)
+{
+    va_list va, va2;
+
+    // Try to print it into the room we already have. If it doesn't fit,
+    // vsnprintf() tells us how much room it needs, so we can make that
+    // much and do it again.
+    va_start(va, format);
+    va_copy(va2, va);
+
+    size_t room = sb->cap - sb->len;
+    int n = vsnprintf(sb_str(sb) + sb->len, room, format, va);
+    va_end(va);
+
+    if (n >= 0 && (size_t)n >= room) {
+        if (sb_reserve(sb, n) == -1)
+            n = -1;
+        else
+            vsnprintf(sb_str(sb) + sb->len, n + 1, format, va2);
+    }
+
+    va_end(va2);
+
+    if (n < 0) {
+        sb_str(sb)[sb->len] = '\0';  // Put back the end, just in case
+        return -1;
+    }
+
+    sb->len += n;
+
+    return 0;
+}
+
+// Empty the string, but keep the room
+void sb_clear(struct strbuf *sb)
+{
+    sb->len = 0;
+    sb_str(sb)[0] = '\0';
+}
+
+// Hand over the string as something you can free(), and leave sb empty
+//
+// Returns NULL if we're out of memory.
+
+char *sb_release(struct strbuf *sb)
+{
+    char *s;
+
+    if (sb->cap > SB_INLINE)
+        s = sb->heap;
+    else if ((s = malloc(sb->len + 1)) != NULL)
+        memcpy(s, sb->small, sb->len + 1);
+    else
+        return NULL;
+
+    sb_init(sb);
+
+    return s;
+}
+
+void sb_free(struct strbuf *sb)
+{
+    if (sb->cap > SB_INLINE)
+        free(sb->heap);
+
+    sb_init(sb);
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+#define MAX_SIZE (10 * 1024 * 1024)
+#define MAX_STRCAT_SECONDS 120  // Skip strcat() if it would take longer
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// One line of a made-up report
+int format_line(char *buf, size_t size, long i)
+{
+    return snprintf(buf, size, "row %ld: widgets=%ld, cost=%.2f\n",
+        i, i * 7 % 1000, i * 0.25);
+}
+
+int main(int argc, char **argv)
+{
+    size_t max_size = argc > 1? atol(argv[1]) * 1024 * 1024: MAX_SIZE;
+
+    // A quick look at the API
+    struct strbuf sb;
+
+    sb_init(&sb);
+    sb_append(&sb, "Hello");
+    sb_append_char(&sb, ',');
+    sb_append_fmt(&sb, " %s! %d", "world", 3490);
+
+    printf("\"%s\" (%zu bytes, %s)\n\n", sb_str(&sb), sb_len(&sb),
+        sb.cap > SB_INLINE? "on the heap": "inline");
+
+    sb_free(&sb);
+
+    char *dest = malloc(max_size + 64);
+
+    if (dest == NULL) {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    printf("%10s %16s %16s %16s\n", "size", "strcat()", "sb_append()",
+        "sb_append_fmt()");
+
+    double strcat_time = 0;
+
+    for (size_t size = 10 * 1024; size <= max_size; size *= 10) {
+        char line[64];
+        long lines = 0;
+
+        if (size * 10 > max_size && size < max_size)
+            size = max_size;  // Make sure we do the biggest size
+
+        // strcat(), skipping it once it'd take too long. Since it's
+        // quadratic, 10 times the size is about 100 times the time.
+        printf("%9zuK", size / 1024);
+
+        if (strcat_time * 100 < MAX_STRCAT_SECONDS) {
+            double t0 = now();
+
+            dest[0] = '\0';
+
+            for (size_t len = 0; len < size; lines++) {
+                len += format_line(line, sizeof line, lines);
+                strcat(dest, line);
+            }
+
+            strcat_time = now() - t0;
+
+            printf(" %14.3fs", strcat_time);
+        } else
+            printf(" %16s", "(too slow)");
+
+        // sb_append() of the same lines
+        double t0 = now();
+
+        sb_init(&sb);
+
+        for (long i = 0; sb_len(&sb) < size; i++) {
+            format_line(line, sizeof line, i);
+            sb_append(&sb, line);
+        }
+
+        double t1 = now();
+
+        if (lines > 0 && strcmp(sb_str(&sb), dest) != 0)
+            printf("MISMATCH!\n");
+
+        printf(" %15.3fs", t1 - t0);
+
+        // sb_append_fmt() straight into the builder
+        struct strbuf sb2;
+
+        sb_init(&sb2);
+
+        t0 = now();
+
+        for (long i = 0; sb_len(&sb2) < size; i++)
+            sb_append_fmt(&sb2, "row %ld: widgets=%ld, cost=%.2f\n",
+                i, i * 7 % 1000, i * 0.25);
+
+        t1 = now();
+
+        printf(" %15.3fs%s\n", t1 - t0,
+            strcmp(sb_str(&sb), sb_str(&sb2)) == 0? "": "  MISMATCH");
+
+        sb_free(&sb);
+        sb_free(&sb2);
+    }
+
+    free(dest);
+}
@@ -0,0 +1,393 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+
+// Precompiled character sets for strspn(), strcspn(), and strpbrk()
+//
+// Every call to strspn(s, accept) has to look at the accept string
+// again to figure out what's in it. If you use the same set over and
+// over, you can do that once and keep the answer in a struct charset.
+//
+// The set is kept two ways:
+//
+// A 256-bit table, one bit per possible byte, for looking at one
+// character at a time.
+//
+// Two 16-byte tables for looking at 16 characters at once with SSSE3's
+// "shuffle bytes" instruction (pshufb). Split a byte into its low and
+// high 4 bits (nibbles). Use the low nibble to pick one of 16 bytes out
+// of a table: each of its 8 bits says whether the character with that
+// low nibble and one of 8 high nibbles is in the set. Then check the
+// bit for the high nibble. pshufb does that first lookup for 16 bytes at
+// once. One table covers high nibbles 0-7 and the other 8-15.
+//
+// The SSSE3 version gets picked at runtime if the CPU has it. Like the
+// scanners in pointers2_strscan.c, it only does aligned loads, so it
+// never reads from a page the string doesn't touch.
+//
+// Since the set is made from a string, '\0' is never in it, and all
+// these stop at the end of the string just like the library ones.
+
+struct charset {
+    uint64_t bits[256 / 64];
+    unsigned char lo[16];  // High nibbles 0-7 for each low nibble
+    unsigned char hi[16];  // High nibbles 8-15
+};
+
+// Make a charset from the characters in set
+void charset_init(struct charset *cs, const char *set)
+{
+    memset(cs, 0, sizeof *cs);
+
+    for (const unsigned char *p = (const unsigned char *)set; *p != '\0'; p++) {
+        cs->bits[*p >> 6] |= 1ULL << (*p & 63);
+
+        if (*p < 128)
+            cs->lo[*p & 15] |= 1 << (*p >> 4);
+        else
+            cs->hi[*p & 15] |= 1 << ((*p >> 4) - 8);
+    }
+}
+
+static int charset_has(const struct charset *cs, unsigned char c)
+{
+    return cs->bits[c >> 6] >> (c & 63) & 1;
+}
+
+// ---------------------------------------------------------------------
+// One character at a time with the bit table
+
+size_t span_table(const struct charset *cs, const char *s)
+{
+    const char *p = s;
+
+    while (charset_has(cs, *p))  // '\0' isn't in the set
+        p++;
+
+    return p - s;
+}
+
+size_t cspan_table(const struct charset *cs, const char *s)
+{
+    const char *p = s;
+
+    while (*p != '\0' && !charset_has(cs, *p))
+        p++;
+
+    return p - s;
+}
+
+// ---------------------------------------------------------------------
+// 16 at a time with SSSE3
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CHARSET_SSSE3 1
+#include <immintrin.h>
+
+// Returns a mask with a 1 bit for each of the 16 bytes in v that's in
+// the set
+__attribute__((target("ssse3")))
+static unsigned members(__m128i v, __m128i lo, __m128i hi)
+{
+    const __m128i bit = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+        1, 2, 4, 8, 16, 32, 64, -128);
+    __m128i nib = _mm_set1_epi8(15);
+
+    __m128i lo_nib = _mm_and_si128(v, nib);
+    __m128i hi_nib = _mm_and_si128(_mm_srli_epi16(v, 4), nib);
+
+    // The row of 8 bits for this low nibble, from whichever table the
+    // high nibble says (signed less than zero means it's 8-15)
+    __m128i top = _mm_cmplt_epi8(v, _mm_setzero_si128());
+    __m128i row = _mm_or_si128(
+        _mm_andnot_si128(top, _mm_shuffle_epi8(lo, lo_nib)),
+        _mm_and_si128(top, _mm_shuffle_epi8(hi, lo_nib)));
+
+    // And the bit in that row for the high nibble
+    __m128i hit = _mm_and_si128(row, _mm_shuffle_epi8(bit, hi_nib));
+
+    return ~_mm_movemask_epi8(_mm_cmpeq_epi8(hit, _mm_setzero_si128()))
+        & 0xffff;
+}
+
+// Find the first byte that's a member (or not, if invert is set), or
+// the terminating NUL
+__attribute__((target("ssse3")))
+static size_t scan_ssse3(const struct charset *cs, const char *s, int invert)
+{
+    __m128i lo = _mm_loadu_si128((const __m128i *)cs->lo);
+    __m128i hi = _mm_loadu_si128((const __m128i *)cs->hi);
+    __m128i zero = _mm_setzero_si128();
+
+    uintptr_t off = (uintptr_t)s % 16;
+    const char *p = s - off;
+
+    for (;;) {
+        __m128i v = _mm_load_si128((const __m128i *)p);
+        unsigned m = members(v, lo, hi);
+        unsigned nul = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+
+        // For span we want the first non-member. '\0' is never a member,
+        // so that covers the end, too.
+        m = invert? ~m & 0xffff: m | nul;
+
+        if (p < s)
+            m = m >> off << off;  // Ignore bytes before the string
+
+        if (m != 0)
+            return p + __builtin_ctz(m) - s;
+
+        p += 16;
+    }
+}
+
+__attribute__((target("ssse3")))
+size_t span_ssse3(const struct charset *cs, const char *s)
+{
+    return scan_ssse3(cs, s, 1);
+}
+
+__attribute__((target("ssse3")))
+size_t cspan_ssse3(const struct charset *cs, const char *s)
+{
+    return scan_ssse3(cs, s, 0);
+}
+
+#else
+#define CHARSET_SSSE3 0
+#endif
+
+// ---------------------------------------------------------------------
+// Picking one at runtime
+
+struct charset_scanner {
+    char *name;
+    size_t (*span)(const struct charset *, const char *);
+    size_t (*cspan)(const struct charset *, const char *);
+};
+
+const struct charset_scanner charset_scanners[] = {
+    {"table", span_table, cspan_table},
+#if CHARSET_SSSE3
+    {"ssse3", span_ssse3, cspan_ssse3},
+#endif
+};
+
+#define CHARSET_SCANNERS \
+    (sizeof charset_scanners / sizeof *charset_scanners)
+
+int charset_scanner_supported(size_t i)
+{
+#if CHARSET_SSSE3
+    __builtin_cpu_init();
+
+    if (strcmp(charset_scanners[i].name, "ssse3") == 0)
+        return __builtin_cpu_supports("ssse3");
+#endif
+    (void)i;
+
+    return 1;
+}
+
+static _Atomic(const struct charset_scanner *) charset_scanner;
+
+static const struct charset_scanner *get_charset_scanner(void)
+{
+    const struct charset_scanner *s = atomic_load_explicit(&charset_scanner,
+        memory_order_acquire);
+
+    if (s == NULL) {
+        for (size_t i = 0; i < CHARSET_SCANNERS; i++)
+            if (charset_scanner_supported(i))
+                s = &charset_scanners[i];
+
+        atomic_store_explicit(&charset_scanner, s, memory_order_release);
+    }
+
+    return s;
+}
+
+// Like strspn(s, set): how many characters at the start of s are in cs
+size_t charset_span(const struct charset *cs, const char *s)
+{
+    return get_charset_scanner()->span(cs, s);
+}
+
+// Like strcspn(s, set): how many characters at the start of s aren't
+size_t charset_cspan(const struct charset *cs, const char *s)
+{
+    return get_charset_scanner()->cspan(cs, s);
+}
+
+// Like strpbrk(s, set): the first character in s that's in cs, or NULL
+char *charset_pbrk(const struct charset *cs, const char *s)
+{
+    s += charset_cspan(cs, s);
+
+    return *s == '\0'? NULL: (char *)s;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+#define MAX_LEN 65536
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// All the bytes but '\0', shuffled, so sets are scattered around
+unsigned char all_bytes[255];
+
+void shuffle_bytes(void)
+{
+    for (int i = 0; i < 255; i++)
+        all_bytes[i] = i + 1;
+
+    srand(3490);
+
+    for (int i = 254; i > 0; i--) {
+        int j = rand() % (i + 1);
+        unsigned char t = all_bytes[i];
+        all_bytes[i] = all_bytes[j];
+        all_bytes[j] = t;
+    }
+}
+
+// Check every scanner against libc for lots of sets, lengths, and
+// alignments
+int check(char *buf)
+{
+    int errors = 0;
+    char set[256];
+
+    for (int size = 0; size < 255; size += 7) {
+        struct charset cs;
+
+        memcpy(set, all_bytes, size);
+        set[size] = '\0';
+        charset_init(&cs, set);
+
+        for (int off = 0; off < 32; off++)
+            for (int len = 0; len < 80; len++) {
+                char *s = buf + off;
+
+                for (int i = 0; i < len; i++)
+                    s[i] = all_bytes[rand() % 255];
+
+                s[len] = '\0';
+
+                for (size_t i = 0; i < CHARSET_SCANNERS; i++) {
+                    if (!charset_scanner_supported(i))
+                        continue;
+
+                    errors += charset_scanners[i].span(&cs, s) !=
+                        strspn(s, set);
+                    errors += charset_scanners[i].cspan(&cs, s) !=
+                        strcspn(s, set);
+                }
+
+                errors += charset_pbrk(&cs, s) != strpbrk(s, set);
+            }
+    }
+
+    return errors;
+}
+
+int main(int argc, char **argv)
+{
+    // How many bytes to scan in total for each measurement
+    double total = argc > 1? atof(argv[1]): 64e6;
+
+    char *buf = malloc(MAX_LEN + 64);
+
+    if (buf == NULL) {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    shuffle_bytes();
+
+    if (check(buf) != 0) {
+        printf("MISMATCH against libc!\n");
+        return 1;
+    }
+
+    printf("Using %s\n", get_charset_scanner()->name);
+
+    static const int set_sizes[] = {1, 4, 16, 64};
+    static const size_t lens[] = {16, 256, 4096, MAX_LEN};
+    char *s = buf + 1;  // Not aligned, to be fair
+    volatile size_t sink = 0;
+
+    for (int f = 0; f < 2; f++) {
+        printf("\n%-7s %5s %7s", f == 0? "span": "cspan", "set", "len");
+        printf(" %9s", f == 0? "strspn": "strcspn");
+
+        for (size_t i = 0; i < CHARSET_SCANNERS; i++)
+            if (charset_scanner_supported(i))
+                printf(" %9s", charset_scanners[i].name);
+
+        printf("   (GB/s)\n");
+
+        for (size_t k = 0; k < sizeof set_sizes / sizeof *set_sizes; k++) {
+            int size = set_sizes[k];
+            char set[256];
+            struct charset cs;
+
+            memcpy(set, all_bytes, size);
+            set[size] = '\0';
+            charset_init(&cs, set);
+
+            for (size_t j = 0; j < sizeof lens / sizeof *lens; j++) {
+                size_t len = lens[j];
+
+                // For span, a string of members with a non-member at the
+                // end. For cspan, the other way around.
+                for (size_t i = 0; i < len - 1; i++)
+                    s[i] = f == 0? set[i % size]: all_bytes[size + i % 64];
+
+                s[len - 1] = f == 0? all_bytes[size]: set[0];
+                s[len] = '\0';
+
+                long iters = total / len;
+
+                printf("%7s %5d %7zu", "", size, len);
+
+                double t0 = now();
+
+                for (long i = 0; i < iters; i++)
+                    sink += f == 0? strspn(s, set): strcspn(s, set);
+
+                printf(" %9.2f", iters * (double)len / (now() - t0) / 1e9);
+
+                for (size_t n = 0; n < CHARSET_SCANNERS; n++) {
+                    const struct charset_scanner *cs_scan = &charset_scanners[n];
+
+                    if (!charset_scanner_supported(n))
+                        continue;
+
+                    t0 = now();
+
+                    for (long i = 0; i < iters; i++)
+                        sink += f == 0? cs_scan->span(&cs, s):
+                            cs_scan->cspan(&cs, s);
+
+                    printf(" %9.2f", iters * (double)len / (now() - t0) / 1e9);
+                }
+
+                printf("\n");
+            }
+        }
+    }
+
+    free(buf);
+}
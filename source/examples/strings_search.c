@@ -0,0 +1,612 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+// Searching for the same strings over and over
+//
+// strstr() has to look at the needle fresh every time you call it. If
+// you're looking for the same needle in millions of log lines, you can
+// do that work once, up front.
+//
+// needle_compile() makes a Horspool skip table for the needle: for each
+// byte that might be under the end of the needle, how far it's safe to
+// slide ahead. On x86 it also uses SSE2 to check 16 spots at once for
+// the needle's first and last bytes, and only does a real compare where
+// both match. That throws out almost every spot in one go.
+//
+// For looking for lots of needles at once, ac_compile() builds an
+// Aho-Corasick automaton. That finds any of them in a single pass over
+// the haystack, no matter how many needles there are.
+//
+// These take haystacks with a length instead of looking for a NUL, so
+// they work on lines in the middle of a big buffer, too.
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SEARCH_SSE2 1
+#else
+#define SEARCH_SSE2 0
+#endif
+
+struct needle {
+    char *s;
+    size_t len;
+    size_t skip[256];  // How far to move on for each last byte
+};
+
+// Compile s into a needle
+//
+// Returns NULL on failure.
+
+struct needle *needle_compile(const char *s)
+{
+    struct needle *n = malloc(sizeof *n);
+
+    if (n == NULL)
+        return NULL;
+
+    n->len = strlen(s);
+
+    if ((n->s = malloc(n->len + 1)) == NULL) {
+        free(n);
+        return NULL;
+    }
+
+    memcpy(n->s, s, n->len + 1);
+
+    // If a byte isn't in the needle (not counting the last spot), we
+    // can jump the whole needle past it. Otherwise, only far enough to
+    // line up its last appearance.
+    for (int i = 0; i < 256; i++)
+        n->skip[i] = n->len;
+
+    for (size_t i = 0; i + 1 < n->len; i++)
+        n->skip[(unsigned char)s[i]] = n->len - 1 - i;
+
+    return n;
+}
+
+void needle_free(struct needle *n)
+{
+    if (n != NULL) {
+        free(n->s);
+        free(n);
+    }
+}
+
+// Horspool, from position i on
+static const char *horspool(const struct needle *n, const char *hay,
+                            size_t len, size_t i)
+{
+    size_t last = n->len - 1;
+
+    while (i + n->len <= len) {
+        unsigned char c = hay[i + last];
+
+        if (c == (unsigned char)n->s[last] &&
+            memcmp(hay + i, n->s, last) == 0)
+            return hay + i;
+
+        i += n->skip[c];
+    }
+
+    return NULL;
+}
+
+// Find the first place n appears in the len bytes at hay
+//
+// Returns a pointer to it, or NULL if it's not there.
+
+const char *needle_search(const struct needle *n, const char *hay, size_t len)
+{
+    size_t i = 0;
+
+    if (n->len == 0)
+        return hay;
+
+    if (n->len > len)
+        return NULL;
+
+#if SEARCH_SSE2
+    __m128i first = _mm_set1_epi8(n->s[0]);
+    __m128i last = _mm_set1_epi8(n->s[n->len - 1]);
+
+    // Look at 16 starting spots at a time: compare 16 bytes with the
+    // needle's first byte, and the 16 bytes len - 1 further along with
+    // its last byte
+    for (; i + 16 + n->len - 1 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(hay + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(hay + i + n->len - 1));
+        unsigned m = _mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+
+        while (m != 0) {
+            int bit = __builtin_ctz(m);
+
+            // The ends match, so check the middle
+            if (n->len <= 2 ||
+                memcmp(hay + i + bit + 1, n->s + 1, n->len - 2) == 0)
+                return hay + i + bit;
+
+            m &= m - 1;  // Clear that bit and try the next
+        }
+    }
+#endif
+
+    // Whatever's left, or all of it without SSE2
+    return horspool(n, hay, len, i);
+}
+
+// ---------------------------------------------------------------------
+// Aho-Corasick
+//
+// It's a trie of all the needles, where each node (state) knows which
+// state to go to next for every possible byte. If the next byte doesn't
+// continue any needle from here, it goes to the state for the longest
+// suffix of what we've seen that's still the start of some needle.
+// That way we never back up in the haystack.
+
+struct ac_state {
+    int32_t next[256];  // ~state if a needle ends in that state
+    int32_t fail;    // Longest proper suffix that's also in the trie
+    int32_t match;   // Needle that ends here, or -1
+    int32_t output;  // Nearest state down the fail chain with a match
+};
+
+struct ac {
+    struct ac_state *states;
+    int count;
+    int cap;
+    size_t *lens;  // Length of each needle
+    int empty;     // First needle that's "", or -1
+};
+
+static int ac_new_state(struct ac *a)
+{
+    if (a->count == a->cap) {
+        int cap = a->cap == 0? 64: a->cap * 2;
+        struct ac_state *s = realloc(a->states, cap * sizeof *s);
+
+        if (s == NULL)
+            return -1;
+
+        a->states = s;
+        a->cap = cap;
+    }
+
+    struct ac_state *s = &a->states[a->count];
+
+    for (int i = 0; i < 256; i++)
+        s->next[i] = -1;
+
+    s->fail = 0;
+    s->match = -1;
+    s->output = -1;
+
+    return a->count++;
+}
+
+void ac_free(struct ac *a)
+{
+    if (a != NULL) {
+        free(a->states);
+        free(a->lens);
+        free(a);
+    }
+}
+
+// Build an automaton for the count needles
+//
+// Returns NULL on failure.
+
+struct ac *ac_compile(const char **needles, int count)
+{
+    struct ac *a = calloc(1, sizeof *a);
+    int32_t *queue = NULL;
+
+    if (a == NULL || (a->lens = malloc(count * sizeof *a->lens)) == NULL ||
+        ac_new_state(a) == -1)
+        goto fail;
+
+    a->empty = -1;
+
+    // Build the trie
+    for (int n = 0; n < count; n++) {
+        int s = 0;
+
+        a->lens[n] = strlen(needles[n]);
+
+        // An empty needle matches at the start of any haystack, like
+        // needle_search() does. Keep it out of the trie, or the root
+        // would be a match and so would every state.
+        if (a->lens[n] == 0) {
+            if (a->empty == -1)
+                a->empty = n;
+
+            continue;
+        }
+
+        for (const unsigned char *p = (const unsigned char *)needles[n];
+             *p != '\0'; p++) {
+
+            if (a->states[s].next[*p] == -1) {
+                int t = ac_new_state(a);
+
+                if (t == -1)
+                    goto fail;
+
+                a->states[s].next[*p] = t;
+            }
+
+            s = a->states[s].next[*p];
+        }
+
+        if (a->states[s].match == -1)
+            a->states[s].match = n;
+    }
+
+    // Fill in the fail links and the missing transitions breadth-first,
+    // so every state's fail state is done before the state itself
+    if ((queue = malloc(a->count * sizeof *queue)) == NULL)
+        goto fail;
+
+    int head = 0, tail = 0;
+    struct ac_state *root = &a->states[0];
+
+    for (int c = 0; c < 256; c++) {
+        if (root->next[c] == -1)
+            root->next[c] = 0;
+        else
+            queue[tail++] = root->next[c];
+    }
+
+    while (head < tail) {
+        int s = queue[head++];
+        struct ac_state *st = &a->states[s];
+        struct ac_state *f = &a->states[st->fail];
+
+        st->output = f->match != -1? st->fail: f->output;
+
+        for (int c = 0; c < 256; c++) {
+            int t = st->next[c];
+
+            if (t == -1) {
+                st->next[c] = f->next[c];
+            } else {
+                a->states[t].fail = f->next[c];
+                queue[tail++] = t;
+            }
+        }
+    }
+
+    // Flip the bits of any transition into a state where a needle ends,
+    // so the search loop can spot a match with a single test
+    for (int i = 0; i < a->count; i++)
+        for (int c = 0; c < 256; c++) {
+            struct ac_state *t = &a->states[a->states[i].next[c]];
+
+            if (t->match != -1 || t->output != -1)
+                a->states[i].next[c] = ~a->states[i].next[c];
+        }
+
+    free(queue);
+
+    return a;
+
+fail:
+    free(queue);
+    ac_free(a);
+
+    return NULL;
+}
+
+// Look for any of the needles in the len bytes at hay
+//
+// Returns a pointer to the match that ends first, and sets *which to
+// its needle number if which isn't NULL. Returns NULL if there aren't
+// any.
+
+const char *ac_search(const struct ac *a, const char *hay, size_t len,
+                      int *which)
+{
+    const struct ac_state *states = a->states;
+    int s = 0;
+
+    // Nothing can end before an empty match at the start
+    if (a->empty != -1) {
+        if (which != NULL)
+            *which = a->empty;
+
+        return hay;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        s = states[s].next[(unsigned char)hay[i]];
+
+        if (s < 0) {
+            // A match ending here is either this state's own, or the
+            // nearest one down its fail chain
+            int m = states[s = ~s].match;
+
+            if (m == -1)
+                m = states[states[s].output].match;
+
+            if (which != NULL)
+                *which = m;
+
+            return hay + i + 1 - a->lens[m];
+        }
+    }
+
+    return NULL;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+#define MAX_NEEDLES 64
+
+struct line {
+    char *s;
+    size_t len;
+};
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Make up a log file that looks more or less like a web server's
+char *make_log(long count, size_t *size)
+{
+    static const char *levels[] = {"INFO", "INFO", "INFO", "DEBUG", "WARN"};
+    static const char *paths[] = {
+        "/api/v1/users", "/api/v1/orders", "/static/app.js", "/healthz",
+        "/api/v2/search", "/login", "/api/v1/cart/items",
+    };
+    static const char *rare[] = {
+        "upstream timeout after 30000ms", "connection reset by peer",
+        "permission denied", "OutOfMemoryError in worker",
+    };
+    static const int status[] = {200, 200, 200, 200, 201, 304, 404, 500, 503};
+
+    char *buf = malloc(count * 256), *p = buf;
+
+    if (buf == NULL)
+        return NULL;
+
+    srand(3490);
+
+    for (long i = 0; i < count; i++) {
+        int r = rand();
+
+        p += sprintf(p, "2024-05-%02d %02d:%02d:%02d.%03d %s [worker-%d] "
+            "%s %s?id=%d status=%d bytes=%d latency_ms=%d",
+            1 + r % 28, r % 24, r % 60, (r >> 6) % 60, (r >> 3) % 1000,
+            levels[r % 5], r % 32, r & 8? "GET": "POST", paths[r % 7],
+            rand() % 100000, status[rand() % 9], rand() % 65536,
+            rand() % 2000);
+
+        if (rand() % 200 == 0)
+            p += sprintf(p, " error=\"%s\"", rare[rand() % 4]);
+
+        *p++ = '\0';  // So strstr() can work on each line
+    }
+
+    *size = p - buf;
+
+    return buf;
+}
+
+// Split a buffer of NUL-terminated lines into a line array
+struct line *split_lines(char *buf, size_t size, long *count)
+{
+    long n = 0;
+
+    for (size_t i = 0; i < size; i++)
+        n += buf[i] == '\0';
+
+    struct line *lines = malloc(n * sizeof *lines);
+
+    if (lines == NULL)
+        return NULL;
+
+    char *p = buf;
+
+    for (long i = 0; i < n; i++) {
+        lines[i].s = p;
+        lines[i].len = strlen(p);
+        p += lines[i].len + 1;
+    }
+
+    *count = n;
+
+    return lines;
+}
+
+// Read a real log file, one line per line
+char *read_log(char *filename, size_t *size)
+{
+    FILE *fp = fopen(filename, "rb");
+
+    if (fp == NULL)
+        return NULL;
+
+    fseek(fp, 0, SEEK_END);
+    long n = ftell(fp);
+    rewind(fp);
+
+    char *buf = malloc(n + 1);
+
+    if (buf == NULL || fread(buf, 1, n, fp) != (size_t)n) {
+        free(buf);
+        fclose(fp);
+        return NULL;
+    }
+
+    fclose(fp);
+
+    // Turn the newlines into NULs
+    for (long i = 0; i < n; i++)
+        if (buf[i] == '\n')
+            buf[i] = '\0';
+
+    if (n == 0 || buf[n - 1] != '\0')
+        buf[n++] = '\0';
+
+    *size = n;
+
+    return buf;
+}
+
+// Count the lines with any of the needles in them, three ways
+//
+// Returns 0 on success, -1 if we're out of memory.
+
+int bench_many(struct line *lines, long count, const char **words, int nwords)
+{
+    struct needle *ns[MAX_NEEDLES];
+    struct ac *a = ac_compile(words, nwords);
+    int ok = a != NULL;
+
+    for (int w = 0; w < nwords; w++)
+        ok &= (ns[w] = needle_compile(words[w])) != NULL;
+
+    if (!ok) {
+        printf("Out of memory\n");
+
+        for (int w = 0; w < nwords; w++)
+            needle_free(ns[w]);
+
+        ac_free(a);
+
+        return -1;
+    }
+
+    long hits0 = 0, hits1 = 0, hits2 = 0;
+
+    double t0 = now();
+
+    for (long i = 0; i < count; i++)
+        for (int w = 0; w < nwords; w++)
+            if (strstr(lines[i].s, words[w]) != NULL) {
+                hits0++;
+                break;
+            }
+
+    double t1 = now();
+
+    for (long i = 0; i < count; i++)
+        for (int w = 0; w < nwords; w++)
+            if (needle_search(ns[w], lines[i].s, lines[i].len) != NULL) {
+                hits1++;
+                break;
+            }
+
+    double t2 = now();
+
+    for (long i = 0; i < count; i++)
+        hits2 += ac_search(a, lines[i].s, lines[i].len, NULL) != NULL;
+
+    double t3 = now();
+
+    printf("Any of %d needles\n", nwords);
+    printf("    strstr():        %.3f s  %ld lines\n", t1 - t0, hits0);
+    printf("    needle_search(): %.3f s  %ld lines%s\n", t2 - t1, hits1,
+        hits0 == hits1? "": "  MISMATCH");
+    printf("    ac_search():     %.3f s  %ld lines%s\n\n", t3 - t2, hits2,
+        hits0 == hits2? "": "  MISMATCH");
+
+    for (int w = 0; w < nwords; w++)
+        needle_free(ns[w]);
+
+    ac_free(a);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    // Either a real log file, or a number of lines to make up
+    size_t size;
+    char *buf;
+
+    if (argc > 1 && (buf = read_log(argv[1], &size)) != NULL)
+        printf("Searching %s\n", argv[1]);
+    else {
+        long count = argc > 1? atol(argv[1]): 2000000;
+
+        if (count <= 0)
+            count = 2000000;
+
+        if ((buf = make_log(count, &size)) == NULL) {
+            printf("Out of memory\n");
+            return 1;
+        }
+    }
+
+    long count;
+    struct line *lines = split_lines(buf, size, &count);
+
+    if (lines == NULL) {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    printf("%ld lines, %zu bytes\n\n", count, size);
+
+    // One needle
+    const char *word = "status=503";
+    struct needle *n = needle_compile(word);
+    long hits0 = 0, hits1 = 0;
+
+    if (n == NULL) {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    double t0 = now();
+
+    for (long i = 0; i < count; i++)
+        hits0 += strstr(lines[i].s, word) != NULL;
+
+    double t1 = now();
+
+    for (long i = 0; i < count; i++)
+        hits1 += needle_search(n, lines[i].s, lines[i].len) != NULL;
+
+    double t2 = now();
+
+    printf("\"%s\"\n", word);
+    printf("    strstr():        %.3f s  %ld lines%s\n", t1 - t0, hits0,
+        hits0 == hits1? "": "  MISMATCH");
+    printf("    needle_search(): %.3f s  %ld lines\n\n", t2 - t1, hits1);
+
+    needle_free(n);
+
+    // Lots of needles. Some we'll see, plus made-up error codes we
+    // won't, to show how each way does as the list gets longer.
+    const char *words[MAX_NEEDLES] = {
+        "status=500", "status=503", "timeout", "connection reset",
+        "permission denied", "OutOfMemoryError", "panic", "segfault",
+    };
+    char codes[MAX_NEEDLES][16];
+
+    for (int w = 8; w < MAX_NEEDLES; w++) {
+        sprintf(codes[w], "error E%04d", w * 37);
+        words[w] = codes[w];
+    }
+
+    for (int nwords = 8; nwords <= MAX_NEEDLES; nwords *= 8)
+        if (bench_many(lines, count, words, nwords) == -1)
+            return 1;
+
+    free(lines);
+    free(buf);
+}
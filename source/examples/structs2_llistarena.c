@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdalign.h>
+#include <time.h>
+
+// A linked list whose nodes come out of an arena instead of one
+// malloc() apiece
+//
+// An arena (also called a bump allocator) grabs big blocks of memory
+// from malloc() and hands out pieces of them just by bumping an offset
+// forward. You can't free a single piece, but you can throw away
+// everything allocated since a mark, or the whole arena, all at once.
+//
+// For when you do need to free single nodes, there's also a pool of
+// fixed-size nodes that keeps freed ones on a free list for reuse.
+//
+// By default the example list is built in an arena. Build with
+// -DLLIST_MALLOC to use malloc() for it instead.
+
+#define ARENA_BLOCK_SIZE (1024 * 1024)
+
+struct arena_block {
+    struct arena_block *prev;  // The block we filled before this one
+    size_t size;               // Bytes of data in this block
+    size_t used;               // Bytes handed out so far
+    max_align_t data[];        // The memory itself, suitably aligned
+};
+
+struct arena {
+    struct arena_block *cur;   // The block we're allocating from
+};
+
+// Where the arena was at some point, so we can go back there
+struct arena_mark {
+    struct arena_block *block;
+    size_t used;
+};
+
+void arena_init(struct arena *a)
+{
+    a->cur = NULL;
+}
+
+// Allocate size bytes from the arena, aligned for any type
+//
+// Returns NULL if out of memory.
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+    // Round up so the next allocation is aligned, too
+    size_t align = alignof(max_align_t);
+    size = (size + align - 1) / align * align;
+
+    struct arena_block *b = a->cur;
+
+    if (b == NULL || b->size - b->used < size) {
+        // Need a new block. Make it big enough for oversize requests.
+        size_t block_size = size > ARENA_BLOCK_SIZE? size: ARENA_BLOCK_SIZE;
+
+        b = malloc(sizeof *b + block_size);
+
+        if (b == NULL)
+            return NULL;
+
+        b->prev = a->cur;
+        b->size = block_size;
+        b->used = 0;
+        a->cur = b;
+    }
+
+    void *p = (char*)b->data + b->used;
+    b->used += size;
+
+    return p;
+}
+
+struct arena_mark arena_mark(struct arena *a)
+{
+    return (struct arena_mark){
+        .block=a->cur, .used=a->cur == NULL? 0: a->cur->used
+    };
+}
+
+// Throw away everything allocated since the mark was made
+void arena_reset(struct arena *a, struct arena_mark m)
+{
+    while (a->cur != m.block) {
+        struct arena_block *prev = a->cur->prev;
+        free(a->cur);
+        a->cur = prev;
+    }
+
+    if (a->cur != NULL)
+        a->cur->used = m.used;
+}
+
+// Throw away everything
+void arena_free(struct arena *a)
+{
+    arena_reset(a, (struct arena_mark){.block=NULL, .used=0});
+}
+
+// A pool of fixed-size elements
+//
+// Freed elements go on a free list, with the link stored right in the
+// freed memory, and get handed back out before we take more from the
+// arena.
+
+struct pool {
+    struct arena arena;
+    size_t elem_size;
+    void *free_list;
+};
+
+void pool_init(struct pool *p, size_t elem_size)
+{
+    arena_init(&p->arena);
+
+    // Every element has to be big enough to hold the free list link
+    p->elem_size = elem_size < sizeof(void*)? sizeof(void*): elem_size;
+    p->free_list = NULL;
+}
+
+void *pool_alloc(struct pool *p)
+{
+    void *elem = p->free_list;
+
+    if (elem != NULL) {
+        p->free_list = *(void**)elem;
+        return elem;
+    }
+
+    return arena_alloc(&p->arena, p->elem_size);
+}
+
+void pool_free(struct pool *p, void *elem)
+{
+    *(void**)elem = p->free_list;
+    p->free_list = elem;
+}
+
+// Free every element at once, whether or not it was pool_free()d
+void pool_destroy(struct pool *p)
+{
+    arena_free(&p->arena);
+    p->free_list = NULL;
+}
+
+// ---------------------------------------------------------------------
+// The linked list
+
+struct node {
+    int data;
+    struct node *next;
+};
+
+#ifdef LLIST_MALLOC
+#define NODE_ALLOC(a) malloc(sizeof(struct node))
+#else
+#define NODE_ALLOC(a) arena_alloc((a), sizeof(struct node))
+#endif
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Build a list of n nodes one way or another, add it up, and tear it
+// down again
+//
+// Returns 0 on success, -1 if we run out of memory.
+
+int bench(size_t n)
+{
+    struct node *head, *cur, *next;
+    long long total;
+    double t0, t1;
+
+    // malloc() and free() every node
+    t0 = now();
+    head = NULL;
+    for (size_t i = 0; i < n; i++) {
+        struct node *new = malloc(sizeof *new);
+
+        if (new == NULL) {
+            for (cur = head; cur != NULL; cur = next) {
+                next = cur->next;
+                free(cur);
+            }
+
+            printf("Out of memory\n");
+            return -1;
+        }
+
+        new->data = i;
+        new->next = head;
+        head = new;
+    }
+    total = 0;
+    for (cur = head; cur != NULL; cur = cur->next)
+        total += cur->data;
+    for (cur = head; cur != NULL; cur = next) {
+        next = cur->next;
+        free(cur);
+    }
+    t1 = now();
+    printf("malloc/free: %.2f s (total %lld)\n", t1 - t0, total);
+
+    // Pool, freeing every node back to the free list
+    struct pool p;
+    pool_init(&p, sizeof(struct node));
+
+    t0 = now();
+    head = NULL;
+    for (size_t i = 0; i < n; i++) {
+        struct node *new = pool_alloc(&p);
+
+        if (new == NULL) {
+            pool_destroy(&p);
+            printf("Out of memory\n");
+            return -1;
+        }
+
+        new->data = i;
+        new->next = head;
+        head = new;
+    }
+    total = 0;
+    for (cur = head; cur != NULL; cur = cur->next)
+        total += cur->data;
+    for (cur = head; cur != NULL; cur = next) {
+        next = cur->next;
+        pool_free(&p, cur);
+    }
+    t1 = now();
+    printf("node pool:   %.2f s (total %lld)\n", t1 - t0, total);
+
+    pool_destroy(&p);
+
+    // Arena, tearing the whole list down in one reset
+    struct arena a;
+    arena_init(&a);
+
+    t0 = now();
+    struct arena_mark m = arena_mark(&a);
+    head = NULL;
+    for (size_t i = 0; i < n; i++) {
+        struct node *new = arena_alloc(&a, sizeof *new);
+
+        if (new == NULL) {
+            arena_free(&a);
+            printf("Out of memory\n");
+            return -1;
+        }
+
+        new->data = i;
+        new->next = head;
+        head = new;
+    }
+    total = 0;
+    for (cur = head; cur != NULL; cur = cur->next)
+        total += cur->data;
+    arena_reset(&a, m);
+    t1 = now();
+    printf("arena:       %.2f s (total %lld)\n", t1 - t0, total);
+
+    arena_free(&a);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct arena a;
+    struct node *head;
+
+    arena_init(&a);
+
+    // Hackishly set up a linked list (11)->(22)->(33)
+    head = NODE_ALLOC(&a);
+    head->data = 11;
+    head->next = NODE_ALLOC(&a);
+    head->next->data = 22;
+    head->next->next = NODE_ALLOC(&a);
+    head->next->next->data = 33;
+    head->next->next->next = NULL;
+
+    // Traverse it
+    for (struct node *cur = head; cur != NULL; cur = cur->next) {
+        printf("%d\n", cur->data);
+    }
+
+    // Free all the nodes in one go (or leak them like the original
+    // example, if we used malloc())
+    arena_free(&a);
+
+    // Then time building and freeing a big list all three ways
+    size_t n = argc > 1? strtoul(argv[1], NULL, 10): 10000000;
+
+    printf("\nBuilding and tearing down %zu nodes:\n", n);
+
+    if (bench(n) == -1)
+        return 1;
+}
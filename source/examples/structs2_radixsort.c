@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+// LSD radix sort on an integer key inside each element
+//
+// Instead of comparing elements, we look at the key one byte at a time,
+// starting from the least significant byte, and deal the elements out
+// into 256 buckets by that byte. After one pass per key byte, the array
+// is sorted. Each pass is stable, so the whole sort is stable, too.
+//
+// The key can be anywhere in the element. Tell us where with
+// offsetof(), and how big it is with sizeof:
+//
+//     radix_sort(a, n, sizeof *a, offsetof(struct animal, leg_count),
+//                sizeof a->leg_count, 1);
+
+// Get the key out of an element as an unsigned number that sorts in
+// the right order.
+//
+// For signed keys, flipping the sign bit moves the negative numbers
+// below the positive ones, since -1 (0xff...) turns into 0x7f... and
+// 0 turns into 0x80....
+static inline uint64_t get_key(const char *elem, size_t width, int is_signed)
+{
+    uint64_t key;
+
+    switch (width) {
+        case 1: { uint8_t k; memcpy(&k, elem, 1); key = k; break; }
+        case 2: { uint16_t k; memcpy(&k, elem, 2); key = k; break; }
+        case 4: { uint32_t k; memcpy(&k, elem, 4); key = k; break; }
+        default: memcpy(&key, elem, 8); break;
+    }
+
+    if (is_signed)
+        key ^= (uint64_t)1 << (width * 8 - 1);
+
+    return key;
+}
+
+// Sort nmemb elements of the given size by the key at key_offset
+//
+// key_width must be 1, 2, 4, or 8. Set is_signed if the key is a
+// signed type.
+//
+// Returns 0 on success, or -1 if we couldn't allocate scratch space or
+// key_width is bad.
+
+int radix_sort(void *base, size_t nmemb, size_t size, size_t key_offset,
+               size_t key_width, int is_signed)
+{
+    if (key_width != 1 && key_width != 2 && key_width != 4 && key_width != 8)
+        return -1;
+
+    if (nmemb < 2)
+        return 0;
+
+    char *tmp = malloc(nmemb * size);
+
+    if (tmp == NULL)
+        return -1;
+
+    // Count up every byte of every key in one trip through the array
+    size_t (*counts)[256] = calloc(key_width, sizeof *counts);
+
+    if (counts == NULL) {
+        free(tmp);
+        return -1;
+    }
+
+    char *p = base;
+
+    for (size_t i = 0; i < nmemb; i++, p += size) {
+        uint64_t key = get_key(p + key_offset, key_width, is_signed);
+
+        for (size_t d = 0; d < key_width; d++)
+            counts[d][(key >> (d * 8)) & 0xff]++;
+    }
+
+    char *src = base, *dst = tmp;
+
+    for (size_t d = 0; d < key_width; d++) {
+        size_t *count = counts[d];
+
+        // If every key has the same byte here, this pass wouldn't
+        // change anything, so skip it
+        if (count[(get_key(src + key_offset, key_width, is_signed) >>
+                  (d * 8)) & 0xff] == nmemb)
+            continue;
+
+        // Turn the counts into starting positions for each bucket
+        size_t pos[256], total = 0;
+
+        for (int b = 0; b < 256; b++) {
+            pos[b] = total;
+            total += count[b];
+        }
+
+        // Deal the elements into their buckets
+        p = src;
+
+        for (size_t i = 0; i < nmemb; i++, p += size) {
+            uint64_t key = get_key(p + key_offset, key_width, is_signed);
+            int b = (key >> (d * 8)) & 0xff;
+
+            memcpy(dst + pos[b]++ * size, p, size);
+        }
+
+        char *swap = src; src = dst; dst = swap;
+    }
+
+    // If the last pass left things in the scratch space, copy back
+    if (src != base)
+        memcpy(base, src, nmemb * size);
+
+    free(counts);
+    free(tmp);
+
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+struct animal {
+    char *name;
+    int leg_count;
+    size_t id;  // Where it was before sorting
+};
+
+int compar_int32(const void *elem0, const void *elem1)
+{
+    const int32_t *x = elem0, *y = elem1;
+
+    return (*x > *y) - (*x < *y);
+}
+
+int compar_int64(const void *elem0, const void *elem1)
+{
+    const int64_t *x = elem0, *y = elem1;
+
+    return (*x > *y) - (*x < *y);
+}
+
+int compar_animal(const void *elem0, const void *elem1)
+{
+    const struct animal *a1 = elem0, *a2 = elem1;
+
+    return (a1->leg_count > a2->leg_count) - (a1->leg_count < a2->leg_count);
+}
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// A random 64-bit number, positive or negative
+int64_t rand64(void)
+{
+    uint64_t r = 0;
+
+    for (int i = 0; i < 4; i++)
+        r = (r << 16) ^ (rand() & 0xffff);
+
+    return (int64_t)r;
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = argc > 1? strtoul(argv[1], NULL, 10): 10000000;
+
+    int32_t *i32a = malloc(n * sizeof *i32a), *i32b = malloc(n * sizeof *i32b);
+    int64_t *i64a = malloc(n * sizeof *i64a), *i64b = malloc(n * sizeof *i64b);
+    struct animal *aa = malloc(n * sizeof *aa), *ab = malloc(n * sizeof *ab);
+
+    if (!i32a || !i32b || !i64a || !i64b || !aa || !ab) {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    srand(1);
+
+    for (size_t i = 0; i < n; i++) {
+        i64a[i] = i64b[i] = rand64();
+        i32a[i] = i32b[i] = (int32_t)i64a[i];
+        aa[i] = ab[i] = (struct animal){.name="Centipede",
+                                        .leg_count=rand() % 2000 - 1000,
+                                        .id=i};
+    }
+
+    double t0, t1, t2;
+
+    printf("Sorting %zu elements\n", n);
+
+    t0 = now();
+    qsort(i32a, n, sizeof *i32a, compar_int32);
+    t1 = now();
+    radix_sort(i32b, n, sizeof *i32b, 0, sizeof *i32b, 1);
+    t2 = now();
+
+    printf("32-bit keys:   qsort %.2f s, radix_sort %.2f s, %s\n",
+        t1 - t0, t2 - t1,
+        memcmp(i32a, i32b, n * sizeof *i32a) == 0? "match": "MISMATCH");
+
+    t0 = now();
+    qsort(i64a, n, sizeof *i64a, compar_int64);
+    t1 = now();
+    radix_sort(i64b, n, sizeof *i64b, 0, sizeof *i64b, 1);
+    t2 = now();
+
+    printf("64-bit keys:   qsort %.2f s, radix_sort %.2f s, %s\n",
+        t1 - t0, t2 - t1,
+        memcmp(i64a, i64b, n * sizeof *i64a) == 0? "match": "MISMATCH");
+
+    t0 = now();
+    qsort(aa, n, sizeof *aa, compar_animal);
+    t1 = now();
+    radix_sort(ab, n, sizeof *ab, offsetof(struct animal, leg_count),
+               sizeof ab->leg_count, 1);
+    t2 = now();
+
+    // qsort() isn't stable, so we can only check the keys against it.
+    // But animals with the same leg count should still be in the order
+    // they started in.
+    int match = 1, stable = 1;
+
+    for (size_t i = 0; i < n; i++) {
+        if (aa[i].leg_count != ab[i].leg_count)
+            match = 0;
+
+        if (i > 0 && ab[i].leg_count == ab[i-1].leg_count &&
+            ab[i].id < ab[i-1].id)
+            stable = 0;
+    }
+
+    printf("struct animal: qsort %.2f s, radix_sort %.2f s, %s, %s\n",
+        t1 - t0, t2 - t1, match? "match": "MISMATCH",
+        stable? "stable": "NOT STABLE");
+
+    free(i32a); free(i32b);
+    free(i64a); free(i64b);
+    free(aa); free(ab);
+}
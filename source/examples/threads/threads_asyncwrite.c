@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <threads.h>
+
+// A background writer with double buffering
+//
+// fwrite() makes the caller wait whenever the stdio buffer fills and
+// has to go out to the OS. Here the caller copies into one buffer while
+// a writer thread fwrite()s the other one. When the caller's buffer is
+// full, the two swap--as long as the writer is done with its buffer,
+// the caller never waits on the file at all.
+//
+// aw_flush() waits until everything written so far has been handed to
+// fwrite() and fflush()ed, so it gives the same guarantee as fflush().
+// aw_close() does a flush and stops the writer thread. It doesn't close
+// the FILE, since the caller opened it.
+//
+// Since the actual writing happens later, aw_write() can't report write
+// errors. They stick, and the next aw_flush() or aw_close() returns EOF.
+//
+// There's only one producer: aw_write() copies into the fill buffer
+// without taking the lock, so just one thread can call aw_write(),
+// aw_flush(), and aw_close() for a given writer. Other threads that
+// want to write need their own async_writer, or their own lock around
+// these calls.
+
+struct async_writer {
+    FILE *fp;
+    thrd_t thread;
+    mtx_t mtx;
+    cnd_t cnd;
+
+    char *fill;         // The caller copies into this one
+    size_t fill_len;
+    char *drain;        // The writer thread writes out this one
+    size_t drain_len;
+    size_t bufsize;
+
+    int draining;       // True while the writer owns drain
+    int flush;          // The writer should fflush() after this buffer
+    int closing;        // The writer should quit when it's done
+    int error;          // A write failed
+    unsigned long submitted, completed;  // Buffers handed off and done
+};
+
+static int aw_thread(void *arg)
+{
+    struct async_writer *w = arg;
+
+    mtx_lock(&w->mtx);
+
+    for (;;) {
+        while (!w->draining && !w->closing)
+            cnd_wait(&w->cnd, &w->mtx);
+
+        if (!w->draining)
+            break;
+
+        int flush = w->flush;
+        w->flush = 0;
+
+        // Write without the lock so the caller can keep filling
+        mtx_unlock(&w->mtx);
+
+        int error = 0;
+
+        if (w->drain_len > 0 &&
+            fwrite(w->drain, 1, w->drain_len, w->fp) != w->drain_len)
+            error = 1;
+
+        if (flush && fflush(w->fp) == EOF)
+            error = 1;
+
+        mtx_lock(&w->mtx);
+
+        w->error |= error;
+        w->drain_len = 0;
+        w->draining = 0;
+        w->completed++;
+        cnd_broadcast(&w->cnd);
+    }
+
+    mtx_unlock(&w->mtx);
+
+    return 0;
+}
+
+// Start writing to fp in the background, with two buffers of bufsize
+//
+// Returns 0 on success, -1 on failure.
+
+int aw_open(struct async_writer *w, FILE *fp, size_t bufsize)
+{
+    w->fp = fp;
+    w->bufsize = bufsize;
+    w->fill_len = w->drain_len = 0;
+    w->draining = w->flush = w->closing = w->error = 0;
+    w->submitted = w->completed = 0;
+
+    w->fill = malloc(bufsize);
+    w->drain = malloc(bufsize);
+
+    if (w->fill == NULL || w->drain == NULL) {
+        free(w->fill);
+        free(w->drain);
+        return -1;
+    }
+
+    mtx_init(&w->mtx, mtx_plain);
+    cnd_init(&w->cnd);
+
+    if (thrd_create(&w->thread, aw_thread, w) != thrd_success) {
+        mtx_destroy(&w->mtx);
+        cnd_destroy(&w->cnd);
+        free(w->fill);
+        free(w->drain);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Hand the fill buffer to the writer, waiting for it to finish the
+// last one first. Returns the number of the buffer we handed off.
+static unsigned long aw_swap(struct async_writer *w, int flush)
+{
+    mtx_lock(&w->mtx);
+
+    while (w->draining)
+        cnd_wait(&w->cnd, &w->mtx);
+
+    char *t = w->drain;
+    w->drain = w->fill;
+    w->drain_len = w->fill_len;
+    w->fill = t;
+    w->fill_len = 0;
+
+    w->draining = 1;
+    w->flush = flush;
+    unsigned long n = ++w->submitted;
+
+    cnd_broadcast(&w->cnd);
+    mtx_unlock(&w->mtx);
+
+    return n;
+}
+
+// Like fwrite(), but returns right away unless both buffers are full
+//
+// Only call this from the one thread that's writing to w.
+size_t aw_write(const void *ptr, size_t size, size_t nmemb,
+                struct async_writer *w)
+{
+    const char *p = ptr;
+    size_t total = size * nmemb;
+
+    while (total > 0) {
+        size_t room = w->bufsize - w->fill_len;
+        size_t n = total < room? total: room;
+
+        memcpy(w->fill + w->fill_len, p, n);
+        w->fill_len += n;
+        p += n;
+        total -= n;
+
+        if (w->fill_len == w->bufsize)
+            aw_swap(w, 0);
+    }
+
+    return nmemb;
+}
+
+// Wait for everything written so far to reach fwrite() and fflush()
+//
+// Returns 0 on success, or EOF if any write has failed.
+
+int aw_flush(struct async_writer *w)
+{
+    unsigned long n = aw_swap(w, 1);
+
+    mtx_lock(&w->mtx);
+
+    while (w->completed < n)
+        cnd_wait(&w->cnd, &w->mtx);
+
+    int error = w->error;
+
+    mtx_unlock(&w->mtx);
+
+    return error? EOF: 0;
+}
+
+// Flush, then stop the writer thread and free the buffers
+//
+// Returns 0 on success, or EOF if any write has failed.
+
+int aw_close(struct async_writer *w)
+{
+    int r = aw_flush(w);
+
+    mtx_lock(&w->mtx);
+    w->closing = 1;
+    cnd_broadcast(&w->cnd);
+    mtx_unlock(&w->mtx);
+
+    thrd_join(w->thread, NULL);
+
+    mtx_destroy(&w->mtx);
+    cnd_destroy(&w->cnd);
+    free(w->fill);
+    free(w->drain);
+
+    return r;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+#define RECORD_SIZE 100
+#define AW_BUFSIZE (1024 * 1024)
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int compar_double(const void *elem0, const void *elem1)
+{
+    const double *x = elem0, *y = elem1;
+
+    return (*x > *y) - (*x < *y);
+}
+
+// Print p50 and p99 of the per-call latencies, and the throughput
+void report(char *name, double *lat, long n, double seconds)
+{
+    qsort(lat, n, sizeof *lat, compar_double);
+
+    printf("%-14s p50 %7.0f ns   p99 %7.0f ns   max %9.0f ns   %7.1f MB/s\n",
+        name, lat[n / 2] * 1e9, lat[n * 99 / 100] * 1e9, lat[n - 1] * 1e9,
+        n * (double)RECORD_SIZE / seconds / (1024 * 1024));
+}
+
+int main(int argc, char **argv)
+{
+    long n = argc > 1? atol(argv[1]): 2000000;
+
+    double *lat = malloc(n * sizeof *lat);
+    char record[RECORD_SIZE];
+    FILE *fp;
+
+    if (lat == NULL) {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    memset(record, 'x', RECORD_SIZE - 1);
+    record[RECORD_SIZE - 1] = '\n';
+
+    printf("Writing %ld records of %d bytes\n", n, RECORD_SIZE);
+
+    // Plain fwrite()
+    if ((fp = tmpfile()) == NULL) {
+        perror("tmpfile");
+        return 1;
+    }
+
+    double start = now();
+
+    for (long i = 0; i < n; i++) {
+        double t0 = now();
+        fwrite(record, sizeof record, 1, fp);
+        lat[i] = now() - t0;
+    }
+
+    fflush(fp);
+
+    report("fwrite():", lat, n, now() - start);
+
+    fclose(fp);
+
+    // The async writer
+    struct async_writer w;
+
+    if ((fp = tmpfile()) == NULL || aw_open(&w, fp, AW_BUFSIZE) == -1) {
+        printf("Couldn't open async writer\n");
+        return 1;
+    }
+
+    start = now();
+
+    for (long i = 0; i < n; i++) {
+        double t0 = now();
+        aw_write(record, sizeof record, 1, &w);
+        lat[i] = now() - t0;
+    }
+
+    if (aw_close(&w) == EOF)
+        printf("Write error!\n");
+
+    report("aw_write():", lat, n, now() - start);
+
+    // Make sure it all got there
+    if (ftell(fp) != n * RECORD_SIZE)
+        printf("MISMATCH: file is %ld bytes, expected %ld\n",
+            ftell(fp), n * RECORD_SIZE);
+
+    fclose(fp);
+    free(lat);
+}
@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
+#include <threads.h>
+
+// Per-thread log buffers with a single writer thread
+//
+// When a bunch of threads all call printf(), they take turns holding
+// the lock on stdout, one line at a time.
+//
+// Here each thread formats its lines into its own buffer, found with
+// thread-specific storage like in threads_tss.c. When the buffer fills
+// up, the whole thing gets handed to one writer thread, which does a
+// single big fwrite() for it. The logging thread grabs an empty buffer
+// and keeps going.
+//
+// Lines from one thread stay in order. Lines from different threads
+// come out in batches, so they're interleaved in chunks rather than
+// line by line.
+
+#define LOGBUF_SIZE (64 * 1024)
+
+struct logbuf {
+    struct logbuf *next;  // For the writer's queue and the free list
+    size_t len;           // Bytes used
+    size_t cap;           // Bytes available
+    char data[];
+};
+
+// The writer thread and everything it shares with the loggers
+static struct {
+    FILE *fp;
+    thrd_t thread;
+    mtx_t mtx;
+    cnd_t cnd;
+    struct logbuf *head, *tail;  // Full buffers waiting to be written
+    struct logbuf *free_list;    // Empty buffers ready for reuse
+    int closing;
+} logger;
+
+static tss_t logbuf_key;
+
+// Queue a buffer for the writer
+static void logbuf_submit(struct logbuf *b)
+{
+    b->next = NULL;
+
+    mtx_lock(&logger.mtx);
+
+    if (logger.tail == NULL)
+        logger.head = b;
+    else
+        logger.tail->next = b;
+
+    logger.tail = b;
+
+    cnd_signal(&logger.cnd);
+    mtx_unlock(&logger.mtx);
+}
+
+// Get an empty buffer, reusing an old one if we can
+static struct logbuf *logbuf_get(void)
+{
+    mtx_lock(&logger.mtx);
+
+    struct logbuf *b = logger.free_list;
+
+    if (b != NULL)
+        logger.free_list = b->next;
+
+    mtx_unlock(&logger.mtx);
+
+    if (b == NULL && (b = malloc(sizeof *b + LOGBUF_SIZE)) == NULL)
+        return NULL;
+
+    b->len = 0;
+    b->cap = LOGBUF_SIZE;
+
+    return b;
+}
+
+// TSS destructor: when a thread exits, send off whatever it had left
+static void logbuf_thread_exit(void *p)
+{
+    struct logbuf *b = p;
+
+    if (b->len > 0)
+        logbuf_submit(b);
+    else
+        free(b);
+}
+
+static int writer(void *arg)
+{
+    (void)arg;
+
+    mtx_lock(&logger.mtx);
+
+    for (;;) {
+        while (logger.head == NULL && !logger.closing)
+            cnd_wait(&logger.cnd, &logger.mtx);
+
+        if (logger.head == NULL)
+            break;  // Closing, and nothing left to write
+
+        // Take the whole queue at once, and write it without the lock
+        struct logbuf *b = logger.head;
+        logger.head = logger.tail = NULL;
+
+        mtx_unlock(&logger.mtx);
+
+        struct logbuf *done = NULL;
+
+        while (b != NULL) {
+            struct logbuf *next = b->next;
+
+            fwrite(b->data, 1, b->len, logger.fp);
+
+            b->next = done;
+            done = b;
+            b = next;
+        }
+
+        mtx_lock(&logger.mtx);
+
+        // Put the empty buffers on the free list, except for any
+        // oversize ones made for a single huge line
+        while (done != NULL) {
+            struct logbuf *next = done->next;
+
+            if (done->cap == LOGBUF_SIZE) {
+                done->next = logger.free_list;
+                logger.free_list = done;
+            } else
+                free(done);
+
+            done = next;
+        }
+    }
+
+    mtx_unlock(&logger.mtx);
+
+    fflush(logger.fp);
+
+    return 0;
+}
+
+// Start logging to fp
+//
+// Returns 0 on success, -1 on failure.
+
+int log_open(FILE *fp)
+{
+    logger.fp = fp;
+    logger.head = logger.tail = logger.free_list = NULL;
+    logger.closing = 0;
+
+    if (tss_create(&logbuf_key, logbuf_thread_exit) != thrd_success)
+        return -1;
+
+    mtx_init(&logger.mtx, mtx_plain);
+    cnd_init(&logger.cnd);
+
+    if (thrd_create(&logger.thread, writer, NULL) != thrd_success) {
+        cnd_destroy(&logger.cnd);
+        mtx_destroy(&logger.mtx);
+        tss_delete(logbuf_key);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Send this thread's buffer to the writer now
+void log_flush(void)
+{
+    struct logbuf *b = tss_get(logbuf_key);
+
+    if (b != NULL && b->len > 0) {
+        logbuf_submit(b);
+        tss_set(logbuf_key, logbuf_get());
+    }
+}
+
+// Like printf(), but into this thread's buffer
+int log_printf(const char *format, ...)
+{
+    struct logbuf *b = tss_get(logbuf_key);
+    va_list va;
+
+    if (b == NULL) {
+        if ((b = logbuf_get()) == NULL)
+            return -1;
+
+        tss_set(logbuf_key, b);
+    }
+
+    va_start(va, format);
+    int len = vsnprintf(b->data + b->len, b->cap - b->len, format, va);
+    va_end(va);
+
+    if (len < 0)
+        return len;
+
+    if ((size_t)len < b->cap - b->len) {
+        b->len += len;  // It fit
+        return len;
+    }
+
+    // It didn't fit, so send what we had and try again in a fresh one
+    if (b->len > 0) {
+        logbuf_submit(b);
+
+        if ((b = logbuf_get()) == NULL) {
+            tss_set(logbuf_key, NULL);
+            return -1;
+        }
+
+        tss_set(logbuf_key, b);
+
+        if ((size_t)len < LOGBUF_SIZE) {
+            va_start(va, format);
+            vsnprintf(b->data, LOGBUF_SIZE, format, va);
+            va_end(va);
+
+            b->len = len;
+
+            return len;
+        }
+    }
+
+    // Too big for any buffer, so make a special one just for this line
+    struct logbuf *big = malloc(sizeof *big + len + 1);
+
+    if (big == NULL)
+        return -1;
+
+    va_start(va, format);
+    vsnprintf(big->data, len + 1, format, va);
+    va_end(va);
+
+    big->len = len;
+    big->cap = len + 1;
+    logbuf_submit(big);
+
+    return len;
+}
+
+// Flush this thread's buffer, wait for the writer to finish, and shut
+// it down. Other threads should have exited (which flushes them) first.
+void log_close(void)
+{
+    struct logbuf *b = tss_get(logbuf_key);
+
+    if (b != NULL) {
+        tss_set(logbuf_key, NULL);
+        logbuf_thread_exit(b);
+    }
+
+    mtx_lock(&logger.mtx);
+    logger.closing = 1;
+    cnd_signal(&logger.cnd);
+    mtx_unlock(&logger.mtx);
+
+    thrd_join(logger.thread, NULL);
+
+    while (logger.free_list != NULL) {
+        struct logbuf *next = logger.free_list->next;
+        free(logger.free_list);
+        logger.free_list = next;
+    }
+
+    tss_delete(logbuf_key);
+    mtx_destroy(&logger.mtx);
+    cnd_destroy(&logger.cnd);
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+#define MAX_THREADS 64
+
+FILE *out;
+long lines_per_thread;
+int use_logbuf;
+
+int run(void *arg)
+{
+    int n = *(int*)arg;
+
+    for (long i = 0; i < lines_per_thread; i++)
+        if (use_logbuf)
+            log_printf("Thread %d: line %ld, x = %d\n", n, i, n * 17);
+        else
+            fprintf(out, "Thread %d: line %ld, x = %d\n", n, i, n * 17);
+
+    return 0;
+}
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double bench(int logbuf, int nthreads)
+{
+    thrd_t t[MAX_THREADS];
+    int id[MAX_THREADS];
+
+    use_logbuf = logbuf;
+    rewind(out);
+
+    double t0 = now();
+
+    if (logbuf)
+        log_open(out);
+
+    for (int i = 0; i < nthreads; i++) {
+        id[i] = i;
+        thrd_create(t + i, run, id + i);
+    }
+
+    for (int i = 0; i < nthreads; i++)
+        thrd_join(t[i], NULL);
+
+    if (logbuf)
+        log_close();
+    else
+        fflush(out);
+
+    double t1 = now();
+
+    // Make sure every line made it out
+    long expect = lines_per_thread * nthreads, count = 0;
+    long pos = ftell(out);
+    int c;
+
+    rewind(out);
+
+    for (long i = 0; i < pos && (c = getc(out)) != EOF; i++)
+        count += c == '\n';
+
+    if (count != expect)
+        printf("MISMATCH: wrote %ld lines, expected %ld\n", count, expect);
+
+    return expect / (t1 - t0);
+}
+
+int main(int argc, char **argv)
+{
+    int max_threads = argc > 1? atoi(argv[1]): 32;
+    lines_per_thread = argc > 2? atol(argv[2]): 200000;
+
+    if (max_threads > MAX_THREADS)
+        max_threads = MAX_THREADS;
+
+    // Log to a temp file so we don't flood the terminal
+    if ((out = tmpfile()) == NULL) {
+        perror("tmpfile");
+        return 1;
+    }
+
+    printf("%7s %16s %16s\n", "threads", "fprintf lines/s", "logbuf lines/s");
+
+    for (int n = 1; n <= max_threads; n *= 2) {
+        double direct = bench(0, n);
+        double buffered = bench(1, n);
+
+        printf("%7d %16.0f %16.0f\n", n, direct, buffered);
+    }
+
+    fclose(out);
+}
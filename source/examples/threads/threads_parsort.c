@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <threads.h>
+
+// A multithreaded drop-in for qsort()
+//
+// The array is cut into one chunk per thread, and each thread qsort()s
+// its own chunk. Then we merge the sorted chunks together in rounds,
+// two at a time, until there's only one left.
+//
+// The merges are parallel, too. Each pair of chunks gets split into
+// several pieces of output, and each piece is merged by its own
+// thread. To figure out where a piece starts, we binary search for
+// how many elements of the left chunk come before that spot in the
+// output.
+
+#define MAX_THREADS 256
+
+// How many threads parallel_qsort() should use. This lives out here so
+// the function can keep the same signature as qsort().
+int parallel_qsort_threads = 4;
+
+typedef int (*compar_func)(const void *, const void *);
+
+// Everything one thread needs to do its part
+struct job {
+    char *a, *b;       // The two sorted runs to merge (or a to sort)
+    size_t na, nb;     // Their lengths in elements
+    char *out;         // Where the merged run goes
+    size_t lo, hi;     // The part of the output this thread makes
+    size_t size;       // Size of each element
+    compar_func compar;
+};
+
+int sort_run(void *arg)
+{
+    struct job *j = arg;
+
+    qsort(j->a, j->na, j->size, j->compar);
+
+    return 0;
+}
+
+// Return how many elements of a come before output position k when a
+// and b are merged. Ties go to a, which keeps the merge stable.
+size_t corank(size_t k, struct job *j)
+{
+    size_t lo = k > j->nb? k - j->nb: 0;
+    size_t hi = k < j->na? k: j->na;
+
+    while (lo < hi) {
+        size_t i = lo + (hi - lo) / 2;
+
+        // If a[i] <= b[k-i-1], then a[i] comes before spot k, too
+        if (j->compar(j->a + i * j->size, j->b + (k - i - 1) * j->size) <= 0)
+            lo = i + 1;
+        else
+            hi = i;
+    }
+
+    return lo;
+}
+
+int merge_run(void *arg)
+{
+    struct job *j = arg;
+    size_t size = j->size;
+
+    size_t i = corank(j->lo, j), i_end = corank(j->hi, j);
+    size_t k = j->lo - i, k_end = j->hi - i_end;  // Positions in b
+
+    char *out = j->out + j->lo * size;
+
+    while (i < i_end && k < k_end) {
+        if (j->compar(j->a + i * size, j->b + k * size) <= 0)
+            memcpy(out, j->a + i++ * size, size);
+        else
+            memcpy(out, j->b + k++ * size, size);
+
+        out += size;
+    }
+
+    // Copy whatever's left over
+    memcpy(out, j->a + i * size, (i_end - i) * size);
+    out += (i_end - i) * size;
+    memcpy(out, j->b + k * size, (k_end - k) * size);
+
+    return 0;
+}
+
+void parallel_qsort(void *base, size_t nmemb, size_t size,
+                    compar_func compar)
+{
+    int nthreads = parallel_qsort_threads;
+
+    if (nthreads > MAX_THREADS)
+        nthreads = MAX_THREADS;
+
+    // Not worth it for tiny arrays, or if we can't get scratch space
+    char *tmp = nthreads > 1 && nmemb >= (size_t)nthreads * 2?
+        malloc(nmemb * size): NULL;
+
+    if (tmp == NULL) {
+        qsort(base, nmemb, size, compar);
+        return;
+    }
+
+    thrd_t t[MAX_THREADS];
+    int started[MAX_THREADS];  // If we couldn't start a thread, we did it
+    struct job jobs[MAX_THREADS];
+    size_t start[MAX_THREADS + 1];  // Where each run begins
+    int runs = nthreads;
+
+    // Sort each chunk in its own thread
+    for (int i = 0; i <= runs; i++)
+        start[i] = nmemb * i / runs;
+
+    for (int i = 0; i < runs; i++) {
+        jobs[i] = (struct job){
+            .a=(char*)base + start[i] * size, .na=start[i+1] - start[i],
+            .size=size, .compar=compar
+        };
+
+        started[i] = thrd_create(t + i, sort_run, jobs + i) == thrd_success;
+
+        if (!started[i])
+            sort_run(jobs + i);
+    }
+
+    for (int i = 0; i < runs; i++)
+        if (started[i])
+            thrd_join(t[i], NULL);
+
+    // Merge pairs of runs back and forth between base and tmp
+    char *src = base, *dst = tmp;
+
+    while (runs > 1) {
+        int pairs = runs / 2;
+        int per_pair = nthreads / pairs;  // Threads for each merge
+        int count = 0;
+
+        for (int p = 0; p < pairs; p++) {
+            size_t s0 = start[2*p], s1 = start[2*p+1], s2 = start[2*p+2];
+            size_t n = s2 - s0;
+
+            for (int i = 0; i < per_pair; i++) {
+                jobs[count] = (struct job){
+                    .a=src + s0 * size, .na=s1 - s0,
+                    .b=src + s1 * size, .nb=s2 - s1,
+                    .out=dst + s0 * size,
+                    .lo=n * i / per_pair, .hi=n * (i + 1) / per_pair,
+                    .size=size, .compar=compar
+                };
+
+                started[count] = thrd_create(t + count, merge_run,
+                    jobs + count) == thrd_success;
+
+                if (!started[count])
+                    merge_run(jobs + count);
+
+                count++;
+            }
+        }
+
+        // An odd run out just gets copied over
+        if (runs % 2 == 1)
+            memcpy(dst + start[runs-1] * size, src + start[runs-1] * size,
+                (start[runs] - start[runs-1]) * size);
+
+        for (int i = 0; i < count; i++)
+            if (started[i])
+                thrd_join(t[i], NULL);
+
+        // Every other boundary goes away
+        for (int i = 0; i <= pairs; i++)
+            start[i] = start[2*i];
+
+        if (runs % 2 == 1)
+            start[++pairs] = nmemb;
+
+        runs = pairs;
+
+        char *swap = src; src = dst; dst = swap;
+    }
+
+    // If we ended up in the scratch space, copy back
+    if (src != base)
+        memcpy(base, src, nmemb * size);
+
+    free(tmp);
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+int compar(const void *elem0, const void *elem1)
+{
+    const int *x = elem0, *y = elem1;
+
+    return (*x > *y) - (*x < *y);
+}
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = argc > 1? strtoul(argv[1], NULL, 10): 10000000;
+    int max_threads = argc > 2? atoi(argv[2]): 64;
+
+    int *orig = malloc(n * sizeof *orig);
+    int *expect = malloc(n * sizeof *expect);
+    int *a = malloc(n * sizeof *a);
+
+    if (orig == NULL || expect == NULL || a == NULL) {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    srand(1);
+
+    for (size_t i = 0; i < n; i++)
+        orig[i] = rand();
+
+    memcpy(expect, orig, n * sizeof *orig);
+
+    double t0 = now();
+    qsort(expect, n, sizeof *expect, compar);
+    double base_time = now() - t0;
+
+    printf("Sorting %zu ints\n", n);
+    printf("qsort():         %6.2f s\n", base_time);
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        memcpy(a, orig, n * sizeof *orig);
+
+        parallel_qsort_threads = threads;
+
+        t0 = now();
+        parallel_qsort(a, n, sizeof *a, compar);
+        double t = now() - t0;
+
+        printf("%3d thread%s:     %6.2f s, %5.2fx, %s\n", threads,
+            threads == 1? " ": "s", t, base_time / t,
+            memcmp(a, expect, n * sizeof *a) == 0? "match": "MISMATCH");
+    }
+
+    free(a);
+    free(expect);
+    free(orig);
+}
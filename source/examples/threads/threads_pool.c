@@ -0,0 +1,595 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdalign.h>
+#include <time.h>
+#include <threads.h>
+#include <stdatomic.h>
+
+// A fixed-size thread pool with work stealing
+//
+// Starting a thread for every little task is expensive. Here we start
+// a few worker threads once and then hand them tasks.
+//
+// Each worker has its own deque of tasks (a Chase-Lev deque). The
+// worker pushes and pops at the bottom end without any locks. When a
+// worker runs out of tasks, it steals from the top end of somebody
+// else's deque with a compare-and-swap.
+//
+// Tasks submitted from outside the pool go into a shared queue behind a
+// mutex, and idle workers grab them from there in batches. Tasks
+// submitted from inside a running task go straight onto that worker's
+// own deque.
+
+#define DEQUE_SIZE 4096  // Must be a power of 2
+#define GRAB_BATCH 64    // Tasks a worker takes from the shared queue
+#define MAX_WORKERS 64
+
+struct task {
+    void (*func)(void *);
+    void *arg;
+};
+
+// A Chase-Lev work-stealing deque
+//
+// The owner works at the bottom, thieves work at the top. The array
+// never wraps around onto a slot that's still in use (push fails when
+// it's full), so a thief that loses the race for a slot just throws
+// away what it read.
+
+struct deque {
+    alignas(64) atomic_long top;
+    alignas(64) atomic_long bottom;
+    struct task tasks[DEQUE_SIZE];
+};
+
+// Owner only. Returns 0 if the deque is full.
+int deque_push(struct deque *d, struct task t)
+{
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    long top = atomic_load_explicit(&d->top, memory_order_acquire);
+
+    if (b - top >= DEQUE_SIZE)
+        return 0;
+
+    d->tasks[b & (DEQUE_SIZE - 1)] = t;
+
+    // Make sure the task is there before thieves can see it
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+
+    return 1;
+}
+
+// Owner only. Returns 0 if the deque is empty.
+int deque_pop(struct deque *d, struct task *t)
+{
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    long top = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    if (top > b) {
+        // It was empty, so put bottom back
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return 0;
+    }
+
+    *t = d->tasks[b & (DEQUE_SIZE - 1)];
+
+    if (top == b) {
+        // Last one, so race the thieves for it
+        int won = atomic_compare_exchange_strong_explicit(&d->top, &top,
+            top + 1, memory_order_seq_cst, memory_order_relaxed);
+
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+
+        return won;
+    }
+
+    return 1;
+}
+
+// Anyone. Returns 0 if the deque was empty or we lost a race.
+int deque_steal(struct deque *d, struct task *t)
+{
+    long top = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+
+    if (top >= b)
+        return 0;
+
+    *t = d->tasks[top & (DEQUE_SIZE - 1)];
+
+    return atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1,
+        memory_order_seq_cst, memory_order_relaxed);
+}
+
+long deque_size(struct deque *d)
+{
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    long top = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    return b - top;
+}
+
+// The pool
+
+struct pool {
+    int nworkers;
+    thrd_t threads[MAX_WORKERS];
+    struct deque *deques[MAX_WORKERS];
+
+    // The shared queue for tasks from outside the pool, a growable ring
+    mtx_t mtx;
+    cnd_t work_cnd;   // Signaled when there's new work
+    cnd_t done_cnd;   // Signaled when pending drops to 0
+    struct task *queue;
+    size_t queue_cap, queue_head, queue_count;
+
+    atomic_int idle;       // Workers asleep on work_cnd
+    atomic_long pending;   // Tasks submitted but not finished
+    int shutdown;
+};
+
+// Which pool this thread works for, if any, and which worker it is
+// there. A task can submit to some other pool, so we need both.
+thread_local struct pool *worker_pool;
+thread_local int worker_id = -1;
+
+struct worker_arg {
+    struct pool *pool;
+    int id;
+};
+
+// Wake up a sleeping worker, if there are any
+static void wake_one(struct pool *p)
+{
+    // Pairs with the fence in the worker before it goes to sleep
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (atomic_load_explicit(&p->idle, memory_order_relaxed) > 0) {
+        mtx_lock(&p->mtx);
+        cnd_signal(&p->work_cnd);
+        mtx_unlock(&p->mtx);
+    }
+}
+
+// Try to steal a task from any other worker
+static int steal_any(struct pool *p, int id, struct task *t)
+{
+    for (int i = 1; i < p->nworkers; i++)
+        if (deque_steal(p->deques[(id + i) % p->nworkers], t))
+            return 1;
+
+    return 0;
+}
+
+// Are there tasks anywhere? Call with the mutex locked.
+static int work_available(struct pool *p)
+{
+    if (p->queue_count > 0)
+        return 1;
+
+    for (int i = 0; i < p->nworkers; i++)
+        if (deque_size(p->deques[i]) > 0)
+            return 1;
+
+    return 0;
+}
+
+// Get a task from the shared queue, moving a batch more onto our own
+// deque while we have the lock. Sleeps if there's nothing anywhere.
+//
+// Returns 1 with a task, 0 to go look around again, or -1 to quit.
+static int take_shared(struct pool *p, int id, struct task *t)
+{
+    mtx_lock(&p->mtx);
+
+    if (p->queue_count == 0) {
+        atomic_fetch_add_explicit(&p->idle, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        while (!p->shutdown && !work_available(p))
+            cnd_wait(&p->work_cnd, &p->mtx);
+
+        atomic_fetch_sub_explicit(&p->idle, 1, memory_order_relaxed);
+
+        if (p->queue_count == 0) {
+            int quit = p->shutdown? -1: 0;
+            mtx_unlock(&p->mtx);
+            return quit;
+        }
+    }
+
+    *t = p->queue[p->queue_head];
+    p->queue_head = (p->queue_head + 1) % p->queue_cap;
+    p->queue_count--;
+
+    for (int i = 0; i < GRAB_BATCH && p->queue_count > 0; i++) {
+        if (!deque_push(p->deques[id], p->queue[p->queue_head]))
+            break;
+
+        p->queue_head = (p->queue_head + 1) % p->queue_cap;
+        p->queue_count--;
+    }
+
+    // Let another sleeper know there's more to steal
+    if (deque_size(p->deques[id]) > 0 || p->queue_count > 0)
+        cnd_signal(&p->work_cnd);
+
+    mtx_unlock(&p->mtx);
+
+    return 1;
+}
+
+static void finish_task(struct pool *p)
+{
+    if (atomic_fetch_sub(&p->pending, 1) == 1) {
+        mtx_lock(&p->mtx);
+        cnd_broadcast(&p->done_cnd);
+        mtx_unlock(&p->mtx);
+    }
+}
+
+static int worker(void *arg)
+{
+    struct worker_arg *wa = arg;
+    struct pool *p = wa->pool;
+    int id = wa->id;
+    struct task t;
+
+    free(wa);
+    worker_pool = p;
+    worker_id = id;
+
+    for (;;) {
+        if (deque_pop(p->deques[id], &t) || steal_any(p, id, &t)) {
+            t.func(t.arg);
+            finish_task(p);
+            continue;
+        }
+
+        int r = take_shared(p, id, &t);
+
+        if (r == -1)
+            break;
+
+        if (r == 1) {
+            t.func(t.arg);
+            finish_task(p);
+        }
+    }
+
+    return 0;
+}
+
+// Stop the first nthreads workers and free everything
+static void pool_cleanup(struct pool *p, int nthreads, int ndeques)
+{
+    mtx_lock(&p->mtx);
+    p->shutdown = 1;
+    cnd_broadcast(&p->work_cnd);
+    mtx_unlock(&p->mtx);
+
+    for (int i = 0; i < nthreads; i++)
+        thrd_join(p->threads[i], NULL);
+
+    for (int i = 0; i < ndeques; i++)
+        free(p->deques[i]);
+
+    free(p->queue);
+    mtx_destroy(&p->mtx);
+    cnd_destroy(&p->work_cnd);
+    cnd_destroy(&p->done_cnd);
+}
+
+// Start a pool with nworkers threads
+//
+// Returns 0 on success, -1 on failure.
+
+int pool_init(struct pool *p, int nworkers)
+{
+    if (nworkers < 1 || nworkers > MAX_WORKERS)
+        return -1;
+
+    p->nworkers = nworkers;
+    p->queue_cap = 1024;
+    p->queue_head = p->queue_count = 0;
+    p->shutdown = 0;
+    atomic_init(&p->idle, 0);
+    atomic_init(&p->pending, 0);
+
+    if ((p->queue = malloc(p->queue_cap * sizeof *p->queue)) == NULL)
+        return -1;
+
+    mtx_init(&p->mtx, mtx_plain);
+    cnd_init(&p->work_cnd);
+    cnd_init(&p->done_cnd);
+
+    for (int i = 0; i < nworkers; i++) {
+        p->deques[i] = aligned_alloc(64, sizeof(struct deque));
+
+        if (p->deques[i] == NULL) {
+            pool_cleanup(p, 0, i);
+            return -1;
+        }
+
+        atomic_init(&p->deques[i]->top, 0);
+        atomic_init(&p->deques[i]->bottom, 0);
+    }
+
+    for (int i = 0; i < nworkers; i++) {
+        struct worker_arg *wa = malloc(sizeof *wa);
+
+        if (wa == NULL) {
+            pool_cleanup(p, i, nworkers);
+            return -1;
+        }
+
+        *wa = (struct worker_arg){.pool=p, .id=i};
+
+        if (thrd_create(p->threads + i, worker, wa) != thrd_success) {
+            free(wa);
+            pool_cleanup(p, i, nworkers);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// Queue up func(arg) to run on some worker
+//
+// Returns 0 on success, -1 if out of memory.
+
+int pool_submit(struct pool *p, void (*func)(void *), void *arg)
+{
+    struct task t = {.func=func, .arg=arg};
+
+    atomic_fetch_add(&p->pending, 1);
+
+    // From inside a task in this pool, use our own deque if there's room.
+    // Only the owner can push there.
+    if (worker_pool == p && deque_push(p->deques[worker_id], t)) {
+        wake_one(p);
+        return 0;
+    }
+
+    mtx_lock(&p->mtx);
+
+    if (p->queue_count == p->queue_cap) {
+        // Double the ring, unwrapping it as we go
+        size_t new_cap = p->queue_cap * 2;
+        struct task *new_queue = malloc(new_cap * sizeof *new_queue);
+
+        if (new_queue == NULL) {
+            mtx_unlock(&p->mtx);
+            atomic_fetch_sub(&p->pending, 1);
+            return -1;
+        }
+
+        for (size_t i = 0; i < p->queue_count; i++)
+            new_queue[i] = p->queue[(p->queue_head + i) % p->queue_cap];
+
+        free(p->queue);
+        p->queue = new_queue;
+        p->queue_cap = new_cap;
+        p->queue_head = 0;
+    }
+
+    p->queue[(p->queue_head + p->queue_count++) % p->queue_cap] = t;
+
+    if (atomic_load(&p->idle) > 0)
+        cnd_signal(&p->work_cnd);
+
+    mtx_unlock(&p->mtx);
+
+    return 0;
+}
+
+// Wait until every submitted task has finished
+//
+// Don't call this from inside a task--it'll wait for itself.
+
+void pool_wait_all(struct pool *p)
+{
+    mtx_lock(&p->mtx);
+
+    while (atomic_load(&p->pending) > 0)
+        cnd_wait(&p->done_cnd, &p->mtx);
+
+    mtx_unlock(&p->mtx);
+}
+
+// Wait for everything to finish, then stop the workers
+void pool_destroy(struct pool *p)
+{
+    pool_wait_all(p);
+    pool_cleanup(p, p->nworkers, p->nworkers);
+}
+
+// Parallel for
+//
+// Calls func(arg, i, end) for consecutive ranges [i, end) that cover
+// [begin, end), each at most grain long, and waits for just those to
+// finish. Like pool_wait_all(), don't call this from inside a task.
+//
+// Returns 0 on success, -1 on failure.
+
+struct range {
+    void (*func)(void *, size_t, size_t);
+    void *arg;
+    size_t begin, end;
+    struct pool *pool;
+    atomic_size_t *left;  // Ranges from this call not done yet
+};
+
+static void range_task(void *arg)
+{
+    struct range *r = arg;
+    struct pool *p = r->pool;
+
+    r->func(r->arg, r->begin, r->end);
+
+    // The caller might free r as soon as this hits 0, so don't touch it
+    // after. It waits on done_cnd, same as pool_wait_all().
+    if (atomic_fetch_sub(r->left, 1) == 1) {
+        mtx_lock(&p->mtx);
+        cnd_broadcast(&p->done_cnd);
+        mtx_unlock(&p->mtx);
+    }
+}
+
+int pool_parallel_for(struct pool *p, size_t begin, size_t end, size_t grain,
+                      void (*func)(void *, size_t, size_t), void *arg)
+{
+    if (end <= begin)
+        return 0;  // Nothing to do
+
+    if (grain == 0)
+        grain = 1;
+
+    size_t count = (end - begin + grain - 1) / grain;
+    struct range *ranges = malloc(count * sizeof *ranges);
+    atomic_size_t left;
+
+    if (ranges == NULL)
+        return -1;
+
+    atomic_init(&left, count);
+
+    for (size_t i = 0; i < count; i++) {
+        size_t b = begin + i * grain;
+
+        ranges[i] = (struct range){
+            .func=func, .arg=arg,
+            .begin=b, .end=end - b < grain? end: b + grain,
+            .pool=p, .left=&left
+        };
+
+        // If it won't go in the queue, just do it here
+        if (pool_submit(p, range_task, ranges + i) == -1)
+            range_task(ranges + i);
+    }
+
+    mtx_lock(&p->mtx);
+
+    while (atomic_load(&left) > 0)
+        cnd_wait(&p->done_cnd, &p->mtx);
+
+    mtx_unlock(&p->mtx);
+
+    free(ranges);
+
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+atomic_long counter;
+
+// About as tiny as a task gets
+void tiny_task(void *arg)
+{
+    (void)arg;
+    atomic_fetch_add_explicit(&counter, 1, memory_order_relaxed);
+}
+
+int tiny_thread(void *arg)
+{
+    tiny_task(arg);
+
+    return 0;
+}
+
+void tiny_range(void *arg, size_t begin, size_t end)
+{
+    (void)arg;
+    atomic_fetch_add_explicit(&counter, end - begin, memory_order_relaxed);
+}
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#define THREAD_BATCH 64  // Threads alive at once for thrd_create()
+
+int main(int argc, char **argv)
+{
+    long n = argc > 1? atol(argv[1]): 1000000;
+    int nworkers = argc > 2? atoi(argv[2]): 4;
+    double t0, t1;
+
+    printf("%ld tiny tasks, %d workers\n", n, nworkers);
+
+    // One thread per task
+    thrd_t t[THREAD_BATCH];
+    int started[THREAD_BATCH];
+    atomic_store(&counter, 0);
+
+    t0 = now();
+
+    for (long i = 0; i < n; i += THREAD_BATCH) {
+        int count = n - i < THREAD_BATCH? n - i: THREAD_BATCH;
+
+        // If we can't start a thread, do the task here instead
+        for (int j = 0; j < count; j++) {
+            started[j] = thrd_create(t + j, tiny_thread, NULL) == thrd_success;
+
+            if (!started[j])
+                tiny_thread(NULL);
+        }
+
+        for (int j = 0; j < count; j++)
+            if (started[j])
+                thrd_join(t[j], NULL);
+    }
+
+    t1 = now();
+
+    printf("thrd_create/join:  %.3f s, %.0f tasks/s (count %ld)\n",
+        t1 - t0, n / (t1 - t0), atomic_load(&counter));
+
+    // The pool
+    struct pool p;
+
+    if (pool_init(&p, nworkers) == -1) {
+        printf("Couldn't start pool\n");
+        return 1;
+    }
+
+    atomic_store(&counter, 0);
+
+    t0 = now();
+
+    for (long i = 0; i < n; i++)
+        pool_submit(&p, tiny_task, NULL);
+
+    pool_wait_all(&p);
+
+    t1 = now();
+
+    printf("pool_submit:       %.3f s, %.0f tasks/s (count %ld)\n",
+        t1 - t0, n / (t1 - t0), atomic_load(&counter));
+
+    // And the same amount of work as a parallel for
+    atomic_store(&counter, 0);
+
+    t0 = now();
+    pool_parallel_for(&p, 0, n, 1024, tiny_range, NULL);
+    t1 = now();
+
+    printf("pool_parallel_for: %.3f s, %.0f items/s (count %ld)\n",
+        t1 - t0, n / (t1 - t0), atomic_load(&counter));
+
+    pool_destroy(&p);
+}
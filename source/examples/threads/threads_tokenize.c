@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <threads.h>
+
+// A tokenizer that threads can share
+//
+// strtok() remembers where it left off in a hidden static variable, so
+// two threads calling it at the same time trample each other. It also
+// writes NULs into your string, and for every character it walks the
+// whole delimiter string to see if it's in there.
+//
+// Here, the delimiters are turned into a 256-bit table once--one bit for
+// each possible byte--so checking a character is one lookup. Where we
+// are in the string lives in a struct tokenizer that the caller owns,
+// so any number of threads can tokenize at once. And the tokens come
+// back as a pointer and a length, so the string is never changed (and
+// can be const, or not NUL-terminated at all).
+//
+// Like strtok(), runs of delimiters are skipped, so there are never any
+// empty tokens.
+
+struct delims {
+    uint64_t bits[4];
+};
+
+struct token {
+    const char *s;
+    size_t len;
+};
+
+struct tokenizer {
+    const char *p, *end;
+    const struct delims *d;
+};
+
+// Build the delimiter table for the characters in set
+void delims_init(struct delims *d, const char *set)
+{
+    memset(d, 0, sizeof *d);
+
+    for (const unsigned char *p = (const unsigned char *)set; *p != '\0'; p++)
+        d->bits[*p >> 6] |= 1ULL << (*p & 63);
+}
+
+static int is_delim(const struct delims *d, unsigned char c)
+{
+    return d->bits[c >> 6] >> (c & 63) & 1;
+}
+
+// Start tokenizing the len bytes at s
+void tok_init(struct tokenizer *t, const char *s, size_t len,
+              const struct delims *d)
+{
+    t->p = s;
+    t->end = s + len;
+    t->d = d;
+}
+
+// Get the next token
+//
+// Returns 1 and fills in *tok, or 0 if there aren't any more.
+
+int tok_next(struct tokenizer *t, struct token *tok)
+{
+    const char *p = t->p, *end = t->end;
+
+    while (p < end && is_delim(t->d, *p))
+        p++;
+
+    if (p == end) {
+        t->p = p;
+        return 0;
+    }
+
+    tok->s = p;
+
+    while (p < end && !is_delim(t->d, *p))
+        p++;
+
+    tok->len = p - tok->s;
+    t->p = p;
+
+    return 1;
+}
+
+// Get up to max tokens at once into toks
+//
+// Returns how many it got, which is 0 when there aren't any more.
+
+size_t tok_batch(struct tokenizer *t, struct token *toks, size_t max)
+{
+    const struct delims *d = t->d;
+    const char *p = t->p, *end = t->end;
+    size_t n = 0;
+
+    // Same as tok_next(), but with everything kept in locals for the
+    // whole batch
+    while (n < max) {
+        while (p < end && is_delim(d, *p))
+            p++;
+
+        if (p == end)
+            break;
+
+        const char *s = p;
+
+        while (p < end && !is_delim(d, *p))
+            p++;
+
+        toks[n].s = s;
+        toks[n].len = p - s;
+        n++;
+    }
+
+    t->p = p;
+
+    return n;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+#define MAX_THREADS 64
+#define BATCH 256
+#define DELIMS ".,?! \n"
+
+struct job {
+    const char *s;
+    size_t len;
+    long tokens;
+    size_t bytes;  // Total length of all the tokens
+};
+
+const struct delims *delims;
+
+int run(void *arg)
+{
+    struct job *j = arg;
+    struct tokenizer t;
+    struct token toks[BATCH];
+    size_t n;
+
+    tok_init(&t, j->s, j->len, delims);
+
+    j->tokens = 0;
+    j->bytes = 0;
+
+    while ((n = tok_batch(&t, toks, BATCH)) > 0) {
+        j->tokens += n;
+
+        for (size_t i = 0; i < n; i++)
+            j->bytes += toks[i].len;
+    }
+
+    return 0;
+}
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = (argc > 1? atol(argv[1]): 256) * 1024 * 1024;
+    int max_threads = argc > 2? atoi(argv[2]): 16;
+
+    if (max_threads > MAX_THREADS)
+        max_threads = MAX_THREADS;
+
+    // Fill a buffer with sentences like the one in the strtok() example
+    static const char *words[] = {
+        "Where", "is", "my", "bacon", "dude", "the", "quick", "brown",
+        "fox", "jumped", "over", "lazy", "dogs", "a", "wombat",
+    };
+    static const char *seps[] = {" ", " ", " ", " ", ", ", "? ", "! ", ".\n"};
+
+    char *text = malloc(size + 32), *copy = malloc(size + 1);
+    size_t len = 0;
+
+    if (text == NULL || copy == NULL) {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    srand(3490);
+
+    while (len < size)
+        len += sprintf(text + len, "%s%s", words[rand() % 15], seps[rand() % 8]);
+
+    len = size;
+    text[len] = '\0';
+
+    struct delims d;
+    delims_init(&d, DELIMS);
+    delims = &d;
+
+    printf("%zu MB of text\n\n", size / (1024 * 1024));
+
+    // strtok(), on a copy since it writes NULs. One thread only--there's
+    // no way to run it in more than one at once.
+    memcpy(copy, text, len + 1);
+
+    double t0 = now();
+    long strtok_tokens = 0;
+    size_t strtok_bytes = 0;
+
+    for (char *tok = strtok(copy, DELIMS); tok != NULL;
+         tok = strtok(NULL, DELIMS)) {
+        strtok_tokens++;
+        strtok_bytes += strlen(tok);
+    }
+
+    double strtok_time = now() - t0;
+
+    printf("strtok():        1 thread   %7.3f s  %8.1f MB/s\n", strtok_time,
+        len / strtok_time / (1024 * 1024));
+
+    // tok_next(), one at a time
+    struct tokenizer t;
+    struct token tok;
+    long next_tokens = 0;
+
+    t0 = now();
+
+    tok_init(&t, text, len, &d);
+
+    while (tok_next(&t, &tok))
+        next_tokens++;
+
+    double next_time = now() - t0;
+
+    printf("tok_next():      1 thread   %7.3f s  %8.1f MB/s%s\n", next_time,
+        len / next_time / (1024 * 1024),
+        next_tokens == strtok_tokens? "": "  MISMATCH");
+
+    // tok_batch(), with the text cut into one piece per thread
+    for (int n = 1; n <= max_threads; n *= 2) {
+        thrd_t th[MAX_THREADS];
+        struct job jobs[MAX_THREADS];
+        const char *p = text;
+
+        for (int i = 0; i < n; i++) {
+            // Cut after a delimiter so no token gets split in two
+            const char *cut = i == n - 1? text + len: text + len * (i + 1) / n;
+
+            while (cut < text + len && !is_delim(&d, *cut))
+                cut++;
+
+            if (cut < p)
+                cut = p;
+
+            jobs[i].s = p;
+            jobs[i].len = cut - p;
+            p = cut;
+        }
+
+        t0 = now();
+
+        for (int i = 0; i < n; i++)
+            thrd_create(th + i, run, jobs + i);
+
+        long tokens = 0;
+        size_t bytes = 0;
+
+        for (int i = 0; i < n; i++) {
+            thrd_join(th[i], NULL);
+            tokens += jobs[i].tokens;
+            bytes += jobs[i].bytes;
+        }
+
+        double batch_time = now() - t0;
+
+        printf("tok_batch(): %5d thread%s %7.3f s  %8.1f MB/s%s\n", n,
+            n == 1? " ": "s", batch_time, len / batch_time / (1024 * 1024),
+            tokens == strtok_tokens && bytes == strtok_bytes? "":
+            "  MISMATCH");
+    }
+
+    free(text);
+    free(copy);
+}
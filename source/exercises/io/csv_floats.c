@@ -0,0 +1,448 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <time.h>
+
+// Reading columns of floating point numbers from CSV, fast
+//
+// point_avg.c reads lines with fscanf("%f,%f,%f"). That's easy, but for
+// every line fscanf() has to go through the format string again, and
+// the conversion goes through the locale machinery.
+//
+// csv_floats() parses a buffer full of rows of comma-separated numbers
+// and puts each column in its own array of doubles.
+//
+// Most numbers in a file like that are short, like 32.5. For those we
+// can collect the digits in an integer (325) and divide by a power of
+// ten (10) that's exactly representable. Since both are exact, the one
+// division gives the correctly rounded answer, the same one strtod()
+// would give. (This is "Clinger's fast path".) That works as long as
+// the digits fit in 53 bits and the power of ten is at most 10^22.
+//
+// Anything else--lots of digits, big exponents, inf, nan--gets handed
+// to strtod(), so the results always match strtod() bit for bit.
+
+#define MAX_FIELD 128  // Longest number we'll copy out for strtod()
+
+// The fast path needs doubles to be evaluated as doubles, not with
+// extra precision
+#if FLT_EVAL_METHOD == 0
+#define CSV_FAST_PATH 1
+#else
+#define CSV_FAST_PATH 0
+#endif
+
+static const double exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+#define MAX_EXACT_POW10 22
+#define MAX_EXACT_INT (1ULL << 53)
+
+// Try to convert the number in [p, end) quickly
+//
+// Returns 1 and sets *out if it worked, 0 if strtod() needs to do it.
+
+static int fast_double(const char *p, const char *end, double *out)
+{
+#if CSV_FAST_PATH
+    int negative = 0;
+
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    uint64_t w = 0;
+    int ndigits = 0, exp10 = 0, any = 0;
+
+    // Integer part, skipping leading zeros
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        any = 1;
+
+        if (w == 0 && *p == '0')
+            continue;
+
+        if (++ndigits > 19)
+            return 0;
+
+        w = w * 10 + (*p - '0');
+    }
+
+    // Fraction part
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+            any = 1;
+            exp10--;
+
+            if (w == 0 && *p == '0')
+                continue;
+
+            if (++ndigits > 19)
+                return 0;
+
+            w = w * 10 + (*p - '0');
+        }
+    }
+
+    if (!any)
+        return 0;
+
+    // Exponent
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        int eneg = 0, e = 0;
+
+        p++;
+
+        if (p < end && (*p == '-' || *p == '+'))
+            eneg = *p++ == '-';
+
+        if (p == end || *p < '0' || *p > '9')
+            return 0;
+
+        for (; p < end && *p >= '0' && *p <= '9'; p++)
+            if (e < 10000)
+                e = e * 10 + (*p - '0');
+
+        exp10 += eneg? -e: e;
+    }
+
+    if (p != end)
+        return 0;  // Something we don't understand
+
+    double d;
+
+    if (w == 0)
+        d = 0;
+
+    else if (w > MAX_EXACT_INT)
+        return 0;
+
+    else if (exp10 < 0) {
+        if (exp10 < -MAX_EXACT_POW10)
+            return 0;
+
+        d = (double)w / exact_pow10[-exp10];
+
+    } else {
+        // Something like 12e25 is fine if we can move some of the zeros
+        // onto the 12 and still be exact
+        for (; exp10 > MAX_EXACT_POW10; exp10--)
+            if ((w *= 10) > MAX_EXACT_INT)
+                return 0;
+
+        d = (double)w * exact_pow10[exp10];
+    }
+
+    *out = negative? -d: d;
+
+    return 1;
+#else
+    (void)p; (void)end; (void)out;
+
+    return 0;
+#endif
+}
+
+// Convert the number in [p, end) with strtod()
+static int slow_double(const char *p, const char *end, double *out)
+{
+    char field[MAX_FIELD];
+    char *stop;
+
+    if (end - p == 0 || end - p >= MAX_FIELD)
+        return 0;
+
+    memcpy(field, p, end - p);
+    field[end - p] = '\0';
+
+    *out = strtod(field, &stop);
+
+    return *stop == '\0';
+}
+
+// Parse rows of ncols comma-separated numbers from the len bytes at buf.
+// The numbers in column c go into cols[c]. Stop after max_rows rows.
+//
+// Returns the number of rows parsed. If errp isn't NULL, it's set to
+// the start of the first bad field or short row, or to NULL if there
+// wasn't an error.
+
+size_t csv_floats(const char *buf, size_t len, int ncols, double **cols,
+                  size_t max_rows, const char **errp)
+{
+    const char *p = buf, *end = buf + len;
+    size_t rows = 0;
+
+    if (errp != NULL)
+        *errp = NULL;
+
+    while (p < end && rows < max_rows) {
+        const char *row = p;
+
+        // Let blank lines go by
+        if (*p == '\n' || *p == '\r') {
+            p++;
+            continue;
+        }
+
+        for (int c = 0; c < ncols; c++) {
+            const char *field = p;
+            char stop = c == ncols - 1? '\n': ',';
+
+            while (p < end && *p != stop && *p != ',' && *p != '\n')
+                p++;
+
+            const char *field_end = p;
+
+            if (stop == '\n' && field_end > field && field_end[-1] == '\r')
+                field_end--;
+
+            if (!fast_double(field, field_end, &cols[c][rows]) &&
+                !slow_double(field, field_end, &cols[c][rows])) {
+                if (errp != NULL)
+                    *errp = field;
+                return rows;
+            }
+
+            // The right separator has to come next (or the end, for the
+            // last field)
+            if (p < end && *p != stop) {
+                if (errp != NULL)
+                    *errp = row;
+                return rows;
+            }
+
+            if (p < end)
+                p++;
+            else if (c != ncols - 1) {
+                if (errp != NULL)
+                    *errp = row;
+                return rows;
+            }
+        }
+
+        rows++;
+    }
+
+    return rows;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+#define NCOLS 3
+#define CHUNK_ROWS 1000000
+#define MIN_LINE 6  // Shortest possible line, like "1,2,3\n"
+
+// A chunk, counting the partial line carried over from the one before,
+// is never bigger than this, so it can't hold more than CHUNK_ROWS
+#define CHUNK_BYTES ((size_t)CHUNK_ROWS * MIN_LINE)
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Mix the bits of d into a running hash, so we can check results are
+// exactly the same without keeping them all
+uint64_t hash_double(uint64_t h, double d)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &d, sizeof bits);
+
+    return (h ^ bits) * 0x100000001b3;
+}
+
+// Read up to CHUNK_ROWS whole lines from fp into buf, carrying any
+// partial line at the end over to the next call in *carry
+//
+// Returns the number of bytes in buf.
+
+size_t read_chunk(FILE *fp, char *buf, size_t *carry)
+{
+    // Read less to leave room for the carry
+    size_t len = *carry;
+    len += fread(buf + len, 1, CHUNK_BYTES - len, fp);
+
+    if (len == 0)
+        return 0;
+
+    // Back up to the last complete line, unless this is the end
+    size_t whole = len;
+
+    if (!feof(fp))
+        while (whole > 0 && buf[whole - 1] != '\n')
+            whole--;
+
+    *carry = len - whole;
+
+    return whole;
+}
+
+// Move the carried-over partial line to the front of buf
+void keep_carry(char *buf, size_t whole, size_t carry)
+{
+    memmove(buf, buf + whole, carry);
+}
+
+int main(int argc, char **argv)
+{
+    long count = argc > 1? atol(argv[1]): 100000000;
+
+    FILE *fp = tmpfile();
+
+    if (fp == NULL) {
+        perror("tmpfile");
+        return 1;
+    }
+
+    // Mostly short numbers like point_avg's input, plus a few that need
+    // the slow path
+    srand(3490);
+
+    for (long i = 0; i < count; i++) {
+        for (int c = 0; c < NCOLS; c++) {
+            double d = rand() / (double)RAND_MAX * 100;
+            char sep = c == NCOLS - 1? '\n': ',';
+
+            switch (rand() % 64) {
+                case 0: fprintf(fp, "%.17g%c", d, sep); break;
+                case 1: fprintf(fp, "%.3e%c", d * 1e200, sep); break;
+                default:
+                    if (i % 2)
+                        fprintf(fp, "%.1f%c", d, sep);
+                    else
+                        fprintf(fp, "-%.6f%c", d, sep);
+            }
+        }
+    }
+
+    size_t bufsize = CHUNK_BYTES + 1;  // Plus a NUL for strtod()
+    char *buf = malloc(bufsize);
+    double *cols[NCOLS], *ref[NCOLS];
+
+    for (int c = 0; c < NCOLS; c++) {
+        cols[c] = malloc(CHUNK_ROWS * sizeof(double));
+        ref[c] = malloc(CHUNK_ROWS * sizeof(double));
+
+        if (cols[c] == NULL || ref[c] == NULL)
+            buf = NULL;
+    }
+
+    if (buf == NULL) {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    printf("%ld rows, %ld bytes\n", count, ftell(fp));
+
+    // fscanf()
+    uint64_t h_scanf = 0;
+    double x, y, z;
+    long rows = 0;
+
+    rewind(fp);
+
+    double t0 = now();
+
+    while (fscanf(fp, "%lf,%lf,%lf", &x, &y, &z) == 3) {
+        h_scanf = hash_double(hash_double(hash_double(h_scanf, x), y), z);
+        rows++;
+    }
+
+    double t_scanf = now() - t0;
+
+    // strtod() and csv_floats(), on the same chunks
+    uint64_t h_strtod = 0, h_csv = 0;
+    double t_strtod = 0, t_csv = 0;
+    long rows_strtod = 0, rows_csv = 0, mismatches = 0;
+    size_t len, carry = 0;
+    const char *err = NULL;
+
+    rewind(fp);
+
+    while ((len = read_chunk(fp, buf, &carry)) > 0) {
+        // strtod() needs a terminator, but that's where the carried
+        // over partial line starts
+        char saved = buf[len];
+        buf[len] = '\0';
+
+        t0 = now();
+
+        char *p = buf, *q;
+        size_t n = 0;
+
+        while (n < CHUNK_ROWS) {
+            for (int c = 0; c < NCOLS; c++) {
+                ref[c][n] = strtod(p, &q);
+
+                if (q == p)
+                    goto done;
+
+                p = q + 1;  // Past the comma or newline
+            }
+
+            n++;
+        }
+done:
+        t_strtod += now() - t0;
+
+        buf[len] = saved;
+
+        t0 = now();
+        size_t m = csv_floats(buf, len, NCOLS, cols, CHUNK_ROWS, &err);
+        t_csv += now() - t0;
+
+        for (size_t i = 0; i < n; i++)
+            for (int c = 0; c < NCOLS; c++)
+                h_strtod = hash_double(h_strtod, ref[c][i]);
+
+        for (size_t i = 0; i < m; i++)
+            for (int c = 0; c < NCOLS; c++) {
+                h_csv = hash_double(h_csv, cols[c][i]);
+
+                if (i < n && memcmp(&cols[c][i], &ref[c][i],
+                        sizeof(double)) != 0)
+                    mismatches++;
+            }
+
+        rows_strtod += n;
+        rows_csv += m;
+
+        if (err != NULL)
+            break;
+
+        keep_carry(buf, len, carry);
+    }
+
+    printf("fscanf():     %7.3f s  %7.1f M rows/s\n", t_scanf,
+        rows / t_scanf / 1e6);
+    printf("strtod():     %7.3f s  %7.1f M rows/s\n", t_strtod,
+        rows_strtod / t_strtod / 1e6);
+    printf("csv_floats(): %7.3f s  %7.1f M rows/s\n", t_csv,
+        rows_csv / t_csv / 1e6);
+
+    if (err != NULL)
+        printf("Parse error!\n");
+
+    if (rows != count || rows_strtod != count || rows_csv != count ||
+        mismatches > 0 || h_scanf != h_csv || h_strtod != h_csv)
+        printf("MISMATCH: %ld values differ\n", mismatches);
+    else
+        printf("All %ld values bit-exact\n", count * NCOLS);
+
+    fclose(fp);
+    free(buf);
+
+    for (int c = 0; c < NCOLS; c++) {
+        free(cols[c]);
+        free(ref[c]);
+    }
+}
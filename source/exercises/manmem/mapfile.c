@@ -0,0 +1,270 @@
+// mmap() isn't part of standard C, so we need to ask for POSIX
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// An alternative to readfile() that doesn't copy the file onto the heap
+//
+// Instead, we ask the OS to map the file into our address space. The
+// pages come straight from the page cache, so there's no fread() copy
+// and no second copy of the data sitting in malloc()'d memory.
+//
+// This is POSIX, not standard C, so it won't work everywhere.
+
+#define MAPFILE_SEQUENTIAL 1  // Hint that we'll read front to back
+
+// Return a read-only pointer to the whole contents of the file
+//
+// The size of the file is stored in *size. Unlike readfile(), this
+// always maps the entire file, no matter where the file position is.
+//
+// An empty file gives back a valid pointer and a size of 0.
+//
+// Only regular files can be mapped. Pipes, terminals, and the like
+// don't have a size to go by, so for those errno is set to EINVAL.
+//
+// Returns NULL on error. Pass the result to unmapfile() when done.
+
+const char *mapfile(FILE *fp, size_t *size, int flags)
+{
+    struct stat st;
+    int fd = fileno(fp);
+
+    if (fd == -1 || fstat(fd, &st) == -1)
+        return NULL;
+
+    if (!S_ISREG(st.st_mode)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    // Too big to fit in our address space
+    if ((uintmax_t)st.st_size > SIZE_MAX) {
+        errno = EFBIG;
+        return NULL;
+    }
+
+    // mmap() won't do zero bytes, so hand back an empty string
+    if (st.st_size == 0) {
+        *size = 0;
+        return "";
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (data == MAP_FAILED)
+        return NULL;
+
+    // This is just a hint, so we don't care if it fails
+    if (flags & MAPFILE_SEQUENTIAL)
+        posix_madvise(data, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    *size = st.st_size;
+
+    return data;
+}
+
+void unmapfile(const char *data, size_t size)
+{
+    if (size > 0)
+        munmap((void*)data, size);
+}
+
+// ---------------------------------------------------------------------
+// readfile() from readfile.c, for comparison
+
+#define BUFSIZE 4096
+
+long remaining_size(FILE *fp)
+{
+    long start, end;
+
+    if ((start = ftell(fp)) == -1)
+        return -1;
+
+    if (fseek(fp, 0, SEEK_END) != 0)
+        return -1;
+
+    end = ftell(fp);
+
+    if (fseek(fp, start, SEEK_SET) != 0 || end < start)
+        return -1;
+
+    return end - start;
+}
+
+char *readfile(FILE *fp, size_t *size)
+{
+    size_t data_size = BUFSIZE;
+    size_t offset = 0;
+    size_t b;
+    long remaining = remaining_size(fp);
+
+    if (remaining != -1)
+        data_size = remaining + 1;
+
+    char *data = malloc(data_size);
+
+    if (data == NULL) {
+        return NULL;
+    }
+
+    while ((b = fread(data + offset, 1, data_size - offset, fp)) > 0) {
+        offset += b;
+
+        if (offset == data_size) {
+            data_size *= 2;
+
+            char *new_data = realloc(data, data_size);
+
+            if (new_data == NULL) {
+                free(data);
+                return NULL;
+            }
+
+            data = new_data;
+        }
+    }
+
+    if (remaining == -1 && offset > 0) {
+        char *new_data = realloc(data, offset);
+
+        if (new_data != NULL)
+            data = new_data;
+    }
+
+    *size = offset;
+
+    return data;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+unsigned long checksum(const char *data, size_t size)
+{
+    unsigned long sum = 0;
+
+    for (size_t i = 0; i < size; i++)
+        sum = sum * 31 + (unsigned char)data[i];
+
+    return sum;
+}
+
+FILE *make_test_file(size_t size)
+{
+    FILE *fp = tmpfile();
+    char block[BUFSIZE];
+
+    if (fp == NULL)
+        return NULL;
+
+    for (int i = 0; i < BUFSIZE; i++)
+        block[i] = i * 7;
+
+    while (size > 0) {
+        size_t n = size < BUFSIZE? size: BUFSIZE;
+        fwrite(block, 1, n, fp);
+        size -= n;
+    }
+
+    // Make sure it's all out of the stdio buffer and in the file before
+    // we try to map it
+    fflush(fp);
+
+    return fp;
+}
+
+int main(int argc, char **argv)
+{
+    // Size of the test file in megabytes
+    size_t mb = argc > 1? strtoul(argv[1], NULL, 10): 1024;
+
+    FILE *fp = make_test_file(mb * 1024 * 1024);
+
+    if (fp == NULL) {
+        perror("tmpfile");
+        return 1;
+    }
+
+    size_t size;
+    double t0, t1;
+
+    // Copy it onto the heap
+    rewind(fp);
+    t0 = now();
+
+    char *data = readfile(fp, &size);
+
+    if (data == NULL) {
+        printf("readfile() failed\n");
+        return 1;
+    }
+
+    unsigned long sum = checksum(data, size);
+
+    t1 = now();
+
+    printf("readfile(): %.2f s, checksum %lx, %zu bytes copied to heap\n",
+        t1 - t0, sum, size);
+
+    free(data);
+
+    // Map it
+    t0 = now();
+
+    const char *map = mapfile(fp, &size, MAPFILE_SEQUENTIAL);
+
+    if (map == NULL) {
+        perror("mapfile");
+        return 1;
+    }
+
+    sum = checksum(map, size);
+
+    t1 = now();
+
+    printf("mapfile():  %.2f s, checksum %lx, 0 bytes copied to heap\n",
+        t1 - t0, sum);
+
+    unmapfile(map, size);
+
+    fclose(fp);
+
+    // And make sure the empty case works
+    if ((fp = tmpfile()) == NULL) {
+        perror("tmpfile");
+        return 1;
+    }
+
+    if ((map = mapfile(fp, &size, 0)) == NULL) {
+        perror("mapfile");
+        return 1;
+    }
+
+    printf("Empty file: ok, size %zu\n", size);
+    unmapfile(map, size);
+    fclose(fp);
+
+    // And that things we can't map are turned away
+    map = mapfile(stdin, &size, 0);
+    printf("stdin: %s\n", map == NULL? "can't map": "mapped");
+
+    if (map != NULL)
+        unmapfile(map, size);
+}
@@ -3,39 +3,73 @@
 
 #define BUFSIZE 4096
 
-char *readfile(FILE *fp, int *size)
+// Return the number of bytes from the current position to the end of
+// the file, or -1 if we can't seek on it (like if it's a pipe).
+
+long remaining_size(FILE *fp)
+{
+    long start, end;
+
+    if ((start = ftell(fp)) == -1)
+        return -1;
+
+    if (fseek(fp, 0, SEEK_END) != 0)
+        return -1;
+
+    end = ftell(fp);
+
+    if (fseek(fp, start, SEEK_SET) != 0 || end < start)
+        return -1;
+
+    return end - start;
+}
+
+char *readfile(FILE *fp, size_t *size)
 {
-    int data_size = BUFSIZE;
-    int offset = 0;
-    int b;
+    size_t data_size = BUFSIZE;
+    size_t offset = 0;
+    size_t b;
+    long remaining = remaining_size(fp);
+
+    // If we know how big the file is, allocate it all at once. The +1
+    // gives fread() room to notice EOF without us having to realloc().
+    if (remaining != -1)
+        data_size = remaining + 1;
+
     char *data = malloc(data_size);
 
     if (data == NULL) {
         return NULL;
     }
 
-    while ((b = fread(data + offset, 1, BUFSIZE, fp)) > 0) {
+    while ((b = fread(data + offset, 1, data_size - offset, fp)) > 0) {
         offset += b;
-        data_size += b;
 
-        char *new_data = realloc(data, data_size);
+        // Out of room? Double the size so that the number of realloc()s
+        // only grows with the log of the file size.
+        if (offset == data_size) {
+            data_size *= 2;
 
-        if (new_data == NULL) {
-            free(data);
-            return NULL;
-        }
+            char *new_data = realloc(data, data_size);
+
+            if (new_data == NULL) {
+                free(data);
+                return NULL;
+            }
 
-        data = new_data;
+            data = new_data;
+        }
     }
 
-    char *new_data = realloc(data, offset);
+    // Shrink to fit, but only if we grew it ourselves--the exact-size
+    // allocation is already just one byte too big
+    if (remaining == -1 && offset > 0) {
+        char *new_data = realloc(data, offset);
 
-    if (new_data == NULL) {
-        free(data);
-        return NULL;
+        if (new_data != NULL)
+            data = new_data;
     }
 
-    data = new_data;
     *size = offset;
 
     return data;
@@ -51,12 +85,18 @@ int main(void)
         return 1;
     }
 
-    int size;
+    size_t size;
     char *data = readfile(fp, &size);
 
-    printf("Read %d bytes:\n", size);
+    if (data == NULL) {
+        printf("Error reading file\n");
+        fclose(fp);
+        return 1;
+    }
+
+    printf("Read %zu bytes:\n", size);
 
-    for (int i = 0; i < size; i++) {
+    for (size_t i = 0; i < size; i++) {
         putchar(data[i]);
     }
 
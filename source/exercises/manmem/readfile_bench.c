@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Compare the original readfile(), which realloc()s after every 4 KiB
+// fread(), against the version in readfile.c that allocates the whole
+// file at once when it can seek, and doubles the buffer when it can't.
+//
+// Usage: ./readfile_bench [megabytes ...]
+//
+// Defaults to 1 MB, 100 MB, and 1024 MB test files.
+
+#define BUFSIZE 4096
+
+// Count how many times each version calls realloc()
+long realloc_count;
+
+void *counted_realloc(void *p, size_t size)
+{
+    realloc_count++;
+    return realloc(p, size);
+}
+
+// The original: grows by BUFSIZE every time through the loop
+char *readfile_old(FILE *fp, size_t *size)
+{
+    size_t data_size = BUFSIZE;
+    size_t offset = 0;
+    size_t b;
+    char *data = malloc(data_size);
+
+    if (data == NULL) {
+        return NULL;
+    }
+
+    while ((b = fread(data + offset, 1, BUFSIZE, fp)) > 0) {
+        offset += b;
+        data_size += b;
+
+        char *new_data = counted_realloc(data, data_size);
+
+        if (new_data == NULL) {
+            free(data);
+            return NULL;
+        }
+
+        data = new_data;
+    }
+
+    if (offset > 0) {
+        char *new_data = counted_realloc(data, offset);
+
+        if (new_data == NULL) {
+            free(data);
+            return NULL;
+        }
+
+        data = new_data;
+    }
+
+    *size = offset;
+
+    return data;
+}
+
+long remaining_size(FILE *fp)
+{
+    long start, end;
+
+    if ((start = ftell(fp)) == -1)
+        return -1;
+
+    if (fseek(fp, 0, SEEK_END) != 0)
+        return -1;
+
+    end = ftell(fp);
+
+    if (fseek(fp, start, SEEK_SET) != 0 || end < start)
+        return -1;
+
+    return end - start;
+}
+
+// The new one from readfile.c. If `seekable` is false, we pretend we
+// couldn't learn the size, which is what happens with a pipe.
+char *readfile_new(FILE *fp, size_t *size, int seekable)
+{
+    size_t data_size = BUFSIZE;
+    size_t offset = 0;
+    size_t b;
+    long remaining = seekable? remaining_size(fp): -1;
+
+    if (remaining != -1)
+        data_size = remaining + 1;
+
+    char *data = malloc(data_size);
+
+    if (data == NULL) {
+        return NULL;
+    }
+
+    while ((b = fread(data + offset, 1, data_size - offset, fp)) > 0) {
+        offset += b;
+
+        if (offset == data_size) {
+            data_size *= 2;
+
+            char *new_data = counted_realloc(data, data_size);
+
+            if (new_data == NULL) {
+                free(data);
+                return NULL;
+            }
+
+            data = new_data;
+        }
+    }
+
+    if (remaining == -1 && offset > 0) {
+        char *new_data = counted_realloc(data, offset);
+
+        if (new_data != NULL)
+            data = new_data;
+    }
+
+    *size = offset;
+
+    return data;
+}
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+FILE *make_test_file(size_t size)
+{
+    FILE *fp = tmpfile();
+    char block[BUFSIZE];
+
+    if (fp == NULL)
+        return NULL;
+
+    for (int i = 0; i < BUFSIZE; i++)
+        block[i] = i;
+
+    while (size > 0) {
+        size_t n = size < BUFSIZE? size: BUFSIZE;
+        fwrite(block, 1, n, fp);
+        size -= n;
+    }
+
+    return fp;
+}
+
+void run(char *name, FILE *fp, int version)
+{
+    size_t size;
+    char *data;
+
+    rewind(fp);
+    realloc_count = 0;
+
+    double t0 = now();
+
+    if (version == 0)
+        data = readfile_old(fp, &size);
+    else
+        data = readfile_new(fp, &size, version == 1);
+
+    double t1 = now();
+
+    if (data == NULL) {
+        printf("  %-20s failed\n", name);
+        return;
+    }
+
+    printf("  %-20s %8.1f MB/s %10ld reallocs\n", name,
+        size / (t1 - t0) / (1024 * 1024), realloc_count);
+
+    free(data);
+}
+
+int main(int argc, char **argv)
+{
+    size_t default_sizes[] = {1, 100, 1024};
+    int count = argc > 1? argc - 1: 3;
+
+    for (int i = 0; i < count; i++) {
+        size_t mb = argc > 1? strtoul(argv[i + 1], NULL, 10):
+                              default_sizes[i];
+
+        FILE *fp = make_test_file(mb * 1024 * 1024);
+
+        if (fp == NULL) {
+            perror("tmpfile");
+            return 1;
+        }
+
+        printf("%zu MB:\n", mb);
+
+        run("old readfile()", fp, 0);
+        run("new, seekable", fp, 1);
+        run("new, as a pipe", fp, 2);
+
+        fclose(fp);
+    }
+}
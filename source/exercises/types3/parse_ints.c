@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+// Parsing a whole buffer full of integers at once
+//
+// my_atoi() and strtol() look at one character at a time and call
+// isdigit() (or something like it) on each, and they have to be called
+// again for every number.
+//
+// parse_ints() takes a buffer of decimal integers separated by spaces,
+// tabs, newlines, or commas, and puts them all in an array. It loads 8
+// characters at a time into a 64-bit word, finds out how many of them
+// are digits with a few bitwise operations, and converts all those
+// digits to a number with three multiplies. ("SIMD within a register",
+// or SWAR.)
+//
+// Each number can have a leading + or -, and must fit in an int64_t.
+//
+// This version assumes a little-endian machine, where the first
+// character ends up in the lowest byte of the word. On anything else it
+// falls back to a digit at a time. (Build with -DPARSE_SWAR=0 to see
+// how that does.)
+
+#ifndef PARSE_SWAR
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define PARSE_SWAR 1
+#else
+#define PARSE_SWAR 0
+#endif
+#endif
+
+#define MAX_DIGITS 19  // INT64_MAX has this many
+
+static int is_sep(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ',';
+}
+
+#if PARSE_SWAR
+
+static const uint64_t pow10[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+};
+
+// Load the 8 characters at p, or as many as there are before end, with
+// zero bytes (not digits) for the rest
+static uint64_t load8(const char *p, const char *end)
+{
+    uint64_t w = 0;
+
+    memcpy(&w, p, end - p < 8? (size_t)(end - p): 8);
+
+    return w;
+}
+
+// How many of the characters in w, starting from the first, are digits?
+static int leading_digits(uint64_t w)
+{
+    // A digit is 0x30-0x39. Its high nibble is 3, and adding 6 to it
+    // leaves its high nibble 3. Anything else changes one or the other.
+    uint64_t hi = w & 0xf0f0f0f0f0f0f0f0;
+    uint64_t hi6 = (w + 0x0606060606060606) & 0xf0f0f0f0f0f0f0f0;
+    uint64_t bad = (hi ^ 0x3030303030303030) | (hi6 ^ 0x3030303030303030);
+
+    // The first non-digit is the lowest nonzero byte. (A carry out of a
+    // non-digit from the + 6 can only mess up the bytes after it.)
+    return bad == 0? 8: __builtin_ctzll(bad) / 8;
+}
+
+// Convert 8 digits (with '0' already subtracted) to a number. The first
+// digit is in the low byte.
+static uint64_t eight_digits(uint64_t w)
+{
+    w = w * 10 + (w >> 8);  // Pairs of digits
+    w = ((w & 0x000000ff000000ff) * (100 + (1000000ULL << 32)) +
+        ((w >> 16) & 0x000000ff000000ff) * (1 + (10000ULL << 32))) >> 32;
+
+    return w;
+}
+
+#endif
+
+// Parse the integers in the len bytes at buf into out, stopping after
+// max_out of them
+//
+// Returns the number parsed. If errp isn't NULL, *errp is set to the
+// position of the first character that's not part of a valid number or
+// separator, or of a number that's too big--or to NULL if there wasn't
+// an error.
+
+size_t parse_ints(const char *buf, size_t len, int64_t *out, size_t max_out,
+                  const char **errp)
+{
+    const char *p = buf, *end = buf + len;
+    size_t count = 0;
+
+    if (errp != NULL)
+        *errp = NULL;
+
+    for (;;) {
+        while (p < end && is_sep(*p))
+            p++;
+
+        if (p == end || count == max_out)
+            return count;
+
+        const char *start = p;
+        int negative = 0;
+
+        if (*p == '-' || *p == '+')
+            negative = *p++ == '-';
+
+        // Leading zeros don't count toward the digit limit
+        const char *digits = p;
+
+        while (p < end && *p == '0')
+            p++;
+
+        uint64_t v = 0;
+        int ndigits = 0;
+
+#if PARSE_SWAR
+        for (;;) {
+            uint64_t w = load8(p, end);
+            int n = leading_digits(w);
+
+            if (n == 0)
+                break;
+
+            if ((ndigits += n) > MAX_DIGITS)
+                goto error;
+
+            // Slide the digits up to the top so the empty spots at the
+            // bottom act as leading zeros
+            w = (w - 0x3030303030303030) << (8 * (8 - n));
+            v = v * pow10[n] + eight_digits(w);
+            p += n;
+
+            if (n < 8)
+                break;
+        }
+#else
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (++ndigits > MAX_DIGITS)
+                goto error;
+
+            v = v * 10 + (*p++ - '0');
+        }
+#endif
+
+        if (p == digits)
+            goto error;  // No digits at all
+
+        if (p < end && !is_sep(*p)) {
+            start = p;  // Junk after the number
+            goto error;
+        }
+
+        // Up to 19 digits fits in a uint64_t, but maybe not an int64_t
+        if (v > (uint64_t)INT64_MAX + negative)
+            goto error;
+
+        out[count++] = negative? (int64_t)(0 - v): (int64_t)v;
+
+        continue;
+
+error:
+        // start is the bad number, or the junk after a good one
+        if (errp != NULL)
+            *errp = start;
+
+        return count;
+    }
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+double now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Quick and dirty random numbers with a range of lengths
+static uint64_t rng = 88172645463325252ULL;
+
+int64_t random_number(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+
+    int64_t x = (int64_t)((rng >> 1) >> (rng % 63));
+
+    return rng & (1ULL << 62)? -x: x;
+}
+
+void try(const char *s)
+{
+    int64_t out[8];
+    const char *err;
+
+    size_t n = parse_ints(s, strlen(s), out, 8, &err);
+
+    printf("\"%s\": %zu parsed", s, n);
+
+    for (size_t i = 0; i < n; i++)
+        printf("%s%lld", i == 0? " (": ", ", (long long)out[i]);
+
+    printf("%s", n > 0? ")": "");
+
+    if (err != NULL)
+        printf(", error at position %td", err - s);
+
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    long count = argc > 1? atol(argv[1]): 100000000;
+
+    try("3490 -3490 +3490");
+    try("1,2,,3\n4");
+    try("12,34,x5");
+    try("12,34x");
+    try("9223372036854775807 -9223372036854775808");
+    try("9223372036854775808");
+    try("000000000000000000000000042 -");
+
+    // Make a buffer full of numbers, one per line
+    char *buf = malloc(count * 21 + 1), *p = buf;
+    int64_t *out = malloc(count * sizeof *out);
+
+    if (buf == NULL || out == NULL) {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    for (long i = 0; i < count; i++)
+        p += sprintf(p, "%lld\n", (long long)random_number());
+
+    size_t len = p - buf;
+
+    printf("\n%ld numbers, %zu bytes\n", count, len);
+
+    // strtol() in a loop
+    double t0 = now();
+
+    long n = 0;
+    char *q = buf, *next;
+
+    for (;;) {
+        long x = strtol(q, &next, 10);
+
+        if (next == q)
+            break;
+
+        out[n++] = x;
+        q = next;
+    }
+
+    double t1 = now();
+
+    uint64_t check0 = 0;
+
+    for (long i = 0; i < n; i++)
+        check0 = check0 * 31 + out[i];
+
+    // parse_ints()
+    memset(out, 0, count * sizeof *out);
+
+    double t2 = now();
+    const char *err;
+    size_t m = parse_ints(buf, len, out, count, &err);
+    double t3 = now();
+
+    uint64_t check1 = 0;
+
+    for (size_t i = 0; i < m; i++)
+        check1 = check1 * 31 + out[i];
+
+    printf("strtol():     %.3f s  %7.1f M numbers/s\n", t1 - t0,
+        n / (t1 - t0) / 1e6);
+    printf("parse_ints(): %.3f s  %7.1f M numbers/s\n", t3 - t2,
+        m / (t3 - t2) / 1e6);
+
+    if ((long)m != n || check0 != check1 || err != NULL)
+        printf("MISMATCH!\n");
+
+    free(buf);
+    free(out);
+}